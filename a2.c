@@ -1,195 +1,255 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
 
-#define MAX_LINE_LENGTH 256
-#define MAX_STUDENTS 1000
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 
-// Define the structure for DomesticStudent and InternationalStudent
-typedef struct {
-    char birthDigits[50];
-    char firstName[50];
-    char lastName[50];
-    int year, month, day;
-    float gpa;
-    char status;  // 'D' for domestic
-} DomesticStudent;
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#define HAVE_GZIP 1
+#endif
+#endif
+
+#include "roster_core.h"
+
+#define MAX_LINE_LENGTH 256          // server request lines
 
+// Settings collected from the command line
 typedef struct {
-    char birthDigits[50];
-    char firstName[50];
-    char lastName[50];
-    int year, month, day;
-    float gpa;
-    char status;  // 'I' for international
-    int toefl;
-} InternationalStudent;
+    int option;
+    int dedup;
+    int aggregate;        // 0 off, 1 by birth year, 2 by birth year and month
+    int queryCount;
+    char **queries;       // --lookup=/--range=/--percentile=/--rank= arguments, answered in order
+    const char *servePath;
+    int pipelineWorkers;  // parser threads for --pipeline, 0 runs everything on one thread
+    int ioBackend;        // IO_STDIO or IO_URING for the input and output files
+    int format;           // FORMAT_* used for the records written
+    int benchRounds;      // --bench-sort: rounds to average, 0 when not benchmarking
+    size_t maxLineLength; // longer input lines are rejected
+    SortPlan sortPlan;    // --sort-by order for the plain sorted output
+    const char *sortSpec; // ... as given, NULL for the built-in order
+    int partitions;       // --partition=year:N, 0 when writing a single output
+    const char *outputPath;
+    int shardIndex;       // --shard=i/n: only the lines starting in the i-th of n byte ranges
+    int shardCount;
+    char **mergeRuns;     // --merge: the sorted runs to merge
+    int mergeRunCount;
+    const char *checkpointDir;  // --checkpoint=DIR[:N]: spill runs of N records and commit progress to DIR
+    int checkpointRecords;
+    int resume;           // --resume: continue from the checkpoint in checkpointDir
+    int hugePages;        // HUGE_PAGES_* for the record and sort buffers
+    int watch;            // --watch: keep the output up to date as lines are appended to the input
+    int sampleSize;       // --sample=N[,SEED[,sorted]]: N random records, 0 when not sampling
+    unsigned long long sampleSeed;
+    int sampleSeeded;     // a seed was given; otherwise one is picked and reported on stderr
+    int sampleSorted;     // write the sample in the sorted order instead of input order
+} Options;
 
 // Function prototypes
-void processFile(FILE *input, FILE *output, int option);
-int getMonthNumber(const char *month);
-void divideBirthDigits(const char *birthDigits, int *day, int *month, int *year);
-int getMonthNumber(const char *month_of_birth);
-void divideBirthDigits(const char *birthDigits, int *day, int *month, int *year);
+int processFile(FILE *input, FILE *output, const Options *options);
 
-const char* getMonthAbbreviation(int month) {
-    const char* months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
-    if (month >= 1 && month <= 12) {
-        return months[month - 1];
-    }
-    return "Error: Invalid month";
-}
+// Where the command's rosters, record arrays and sort scratch come from; NULL for malloc
+static const LargeAllocator *largeBuffers = NULL;
 
-// Jan -> 1, Feb -> 2, etc
-int getMonthNumber(const char *month) {
-    const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
-    for (int i = 0; i < 12; i++) {
-        if (strcmp(month, months[i]) == 0) return i + 1;
-    }
-    return -1;
-}
+#if defined(__linux__)
+// --huge-pages: the large buffers of 2 MiB or more are mapped on their own, the smaller ones come from
+// malloc. Installed as largeBuffers, and given to the library contexts, before anything is allocated.
+#define HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+#define LARGE_BUFFER_MIN_BYTES HUGE_PAGE_SIZE
+#define LARGE_BUFFER_HEADER 64     // holds a LargeBuffer and keeps the returned pointer cache-line aligned
 
-// Function to divide birthdate string into day, month, and year
-void divideBirthDigits(const char *birthDigits, int *day, int *month, int *year) {
-    char monthStr[4];
-    sscanf(birthDigits, "%3s-%d-%d", monthStr, day, year);
-    *month = getMonthNumber(monthStr);
-}
+static int hugePageMode = HUGE_PAGES_OFF;
 
-// Helper function to check if a string is a valid float
-int isFloat(const char *str) {
-    char *endptr;
-    strtod(str, &endptr);
-    return *endptr == '\0';
-}
+// The header in front of every buffer; mapped is 0 for the ones that came from malloc
+typedef struct LargeBuffer {
+    size_t mapped;
+    struct LargeBuffer *previous, *next;  // the live mapped buffers, under hugeLock
+} LargeBuffer;
 
-// Helper function to check if a string is a valid integer
-int isInteger(const char *str) {
-    char *endptr;
-    strtol(str, &endptr, 10);
-    return *endptr == '\0';
-}
+// What --huge-pages actually obtained, reported when the run ends
+static atomic_int hugeBuffers;
+static atomic_llong hugeMappedBytes;
+static atomic_llong hugeExplicitBytes;
+static atomic_int hugeExplicitFallbacks;
 
-// Function to check if the line has at least four arguments (minimum for 'D' status)
-int isValidLine(const char *line) {
-    int spaceCount = 0;
-    for (int i = 0; line[i] != '\0'; i++) {
-        if (line[i] == ' ') {
-            spaceCount++;
+// The transparent huge pages are sampled once, when the live mapped bytes are at their peak
+static pthread_mutex_t hugeLock = PTHREAD_MUTEX_INITIALIZER;
+static LargeBuffer *hugeLive;
+static long long hugeLiveBytes;
+static long long hugePeakBytes;
+static int hugePeakSampled;
+static long long hugeTransparentBytes;
+
+// Bytes of the live mapped buffers backed by transparent huge pages, in one pass over /proc/self/smaps.
+// Neighbouring mappings with the same flags share one entry, so each entry is counted once, up to the
+// bytes of the live buffers inside it. Called with hugeLock held.
+long long transparentHugeBytes(void) {
+    FILE *smaps = fopen("/proc/self/smaps", "r");
+    if (smaps == NULL) {
+        return 0;
+    }
+    char line[512];
+    long long inside = 0, bytes = 0;
+    while (fgets(line, sizeof(line), smaps) != NULL) {
+        unsigned long start, end;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            inside = 0;
+            for (LargeBuffer *buffer = hugeLive; buffer != NULL; buffer = buffer->next) {
+                uintptr_t low = (uintptr_t)buffer, high = low + buffer->mapped;
+                if (low < start) low = start;
+                if (high > end) high = end;
+                if (high > low) inside += (long long)(high - low);
+            }
+        } else if (inside > 0 && strncmp(line, "AnonHugePages:", 14) == 0) {
+            long long huge = atoll(line + 14) * 1024;
+            bytes += huge < inside ? huge : inside;
         }
     }
-    return spaceCount >= 3;
+    fclose(smaps);
+    return bytes;
 }
 
-int isAlphabet(char c) {
-    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+// Sample once the peak has been reached, before it is left or the run ends. Called with hugeLock held.
+void sampleHugePagesAtPeak(void) {
+    if (!hugePeakSampled && hugeLiveBytes > 0 && hugeLiveBytes == hugePeakBytes) {
+        hugeTransparentBytes = transparentHugeBytes();
+        hugePeakSampled = 1;
+    }
 }
 
-// Function to validate line format with specific error reporting
-int validateLineFormat(const char *line, int *requiresTOEFL) {
-    char birthDigits[50], firstName[50], lastName[50], gpaStr[20], statusChar, toeflStr[20];
-    int fieldsRead;
-
-    // Attempt to parse the line into components
-    fieldsRead = sscanf(line, "%49s %49s %s %19s %c %19s", firstName, lastName, birthDigits, gpaStr, &statusChar, toeflStr);
+void *largeMap(size_t bytes, size_t *mapped) {
+    size_t length = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
 
-    // Check if we have at least 4 fields
-    if (fieldsRead < 5) {
-        fprintf(stderr, "Error: Line must contain at least 5 fields (FirstName LastName BirthDate GPA Status)\n");
-        return 0;
+#ifdef MAP_HUGETLB
+    if (hugePageMode == HUGE_PAGES_EXPLICIT) {
+        void *pages = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (pages != MAP_FAILED) {
+            atomic_fetch_add(&hugeExplicitBytes, (long long)length);
+            *mapped = length;
+            return pages;
+        }
+        atomic_fetch_add(&hugeExplicitFallbacks, 1);
     }
+#endif
 
-    // Check if the name fields are alphabetic
-    for (int i = 0; i < strlen(firstName); i++) {
-        if (!isAlphabet(firstName[i])) {
-            fprintf(stderr, "Error: Invalid first name - Contains non-alphabetical characters: %s\n", firstName);
-            return 0;
-        }
+    // Over-map by one huge page and trim, so whole huge pages fit the buffer
+    char *raw = mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
     }
-    for (int i = 0; i < strlen(lastName); i++) {
-        if (!isAlphabet(lastName[i])) {
-            fprintf(stderr, "Error: Invalid last name - Contains non-alphabetical characters: %s\n", lastName);
-            return 0;
-        }
+    char *aligned = (char *)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (aligned > raw) {
+        munmap(raw, aligned - raw);
     }
+    munmap(aligned + length, raw + HUGE_PAGE_SIZE - aligned);
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, length, MADV_HUGEPAGE);
+#endif
+    *mapped = length;
+    return aligned;
+}
 
-    // Check if GPA is a valid float and within the range 0.0 to 4.3
-    float gpa = atof(gpaStr);
-    if (!isFloat(gpaStr) || gpa < 0.0 || gpa > 4.3) {
-        fprintf(stderr, "Error: Invalid GPA - Not in range 0.0 to 4.3: %s\n", gpaStr);
-        return 0;
-    }
+void *hugeAlloc(size_t bytes) {
+    size_t total = bytes + LARGE_BUFFER_HEADER, mapped = 0;
+    char *base = NULL;
 
-    // Check if status is either 'I' or 'D'
-    if (statusChar != 'I' && statusChar != 'D') {
-        fprintf(stderr, "Error: Invalid status - Expected 'I' or 'D', found: %c\n", statusChar);
-        return 0;
+    if (total >= LARGE_BUFFER_MIN_BYTES) {
+        base = largeMap(total, &mapped);
+        if (base != NULL) {
+            atomic_fetch_add(&hugeBuffers, 1);
+            atomic_fetch_add(&hugeMappedBytes, (long long)mapped);
+        }
     }
-
-    // If status is 'I', ensure TOEFL score is provided and valid
-    if (statusChar == 'I') {
-        *requiresTOEFL = 1;
-        if (fieldsRead != 6 || !isInteger(toeflStr)) {
-            fprintf(stderr, "Error: Invalid TOEFL score - Expected an integer: %s\n", toeflStr);
-            return 0;
+    if (base != NULL) {
+        LargeBuffer *buffer = (LargeBuffer *)base;
+        buffer->mapped = mapped;
+        pthread_mutex_lock(&hugeLock);
+        buffer->previous = NULL;
+        buffer->next = hugeLive;
+        if (hugeLive != NULL) hugeLive->previous = buffer;
+        hugeLive = buffer;
+        hugeLiveBytes += (long long)mapped;
+        if (hugeLiveBytes > hugePeakBytes) {
+            hugePeakBytes = hugeLiveBytes;
+            hugePeakSampled = 0;
         }
-    } else {
-        *requiresTOEFL = 0;
-        if (fieldsRead > 5) {
-            fprintf(stderr, "Error: Extra arguments found for 'D' status\n");
-            return 0;
+        pthread_mutex_unlock(&hugeLock);
+        return base + LARGE_BUFFER_HEADER;
+    }
+    if (base == NULL) {
+        base = malloc(total);
+        if (base == NULL) {
+            return NULL;
         }
     }
-
-    return 1;
+    ((LargeBuffer *)base)->mapped = 0;
+    return base + LARGE_BUFFER_HEADER;
 }
 
-// Function to compare two students based on the sorting criteria
-int compareStudents(const void *a, const void *b) {
-    DomesticStudent *studentA = (DomesticStudent *)a;
-    DomesticStudent *studentB = (DomesticStudent *)b;
-
-    int dayA, monthA, yearA, dayB, monthB, yearB;
-
-    // Divide birth digits into day, month, and year for both students
-    divideBirthDigits(studentA->birthDigits, &dayA, &monthA, &yearA);
-    divideBirthDigits(studentB->birthDigits, &dayB, &monthB, &yearB);
-
-    // Compare by year, month, day of birth
-    if (yearA != yearB) return yearA - yearB;
-    if (monthA != monthB) return monthA - monthB;
-    if (dayA != dayB) return dayA - dayB;
-
-    // Compare by last name
-    int lastNameComparison = strcmp(studentA->lastName, studentB->lastName);
-    if (lastNameComparison != 0) {
-        return lastNameComparison;
-    }
-
-    // Compare by first name
-    int firstNameComparison = strcmp(studentA->firstName, studentB->firstName);
-    if (firstNameComparison != 0) {
-        return firstNameComparison;
-    }
-
-    // Compare by GPA
-    if (studentA->gpa != studentB->gpa) {
-        return (studentA->gpa > studentB->gpa) ? -1 : 1; // Higher GPA comes first
+void hugeFree(void *pointer) {
+    LargeBuffer *buffer = (LargeBuffer *)((char *)pointer - LARGE_BUFFER_HEADER);
+    size_t mapped = buffer->mapped;
+    if (mapped == 0) {
+        free(buffer);
+        return;
     }
+    pthread_mutex_lock(&hugeLock);
+    sampleHugePagesAtPeak();
+    if (buffer->previous != NULL) buffer->previous->next = buffer->next; else hugeLive = buffer->next;
+    if (buffer->next != NULL) buffer->next->previous = buffer->previous;
+    hugeLiveBytes -= (long long)mapped;
+    pthread_mutex_unlock(&hugeLock);
+    munmap(buffer, mapped);
+}
 
-    // Compare by TOEFL if available
-    if (studentA->status == 'I' && studentB->status == 'I') {
-        InternationalStudent *intlA = (InternationalStudent *)studentA;
-        InternationalStudent *intlB = (InternationalStudent *)studentB;
-        return intlB->toefl - intlA->toefl;
-    }
+// --huge-pages counters, on stderr so the output stays unchanged
+void reportHugePages(void) {
+    const double mebibyte = 1024.0 * 1024.0;
+    pthread_mutex_lock(&hugeLock);
+    sampleHugePagesAtPeak();
+    long long transparent = hugeTransparentBytes, peak = hugePeakBytes;
+    pthread_mutex_unlock(&hugeLock);
+    fprintf(stderr, "Huge pages: %d buffers mapped (%.1f MiB), explicit %.1f MiB (%d fell back), "
+            "transparent %.1f MiB of %.1f MiB at the peak\n",
+            atomic_load(&hugeBuffers), atomic_load(&hugeMappedBytes) / mebibyte,
+            atomic_load(&hugeExplicitBytes) / mebibyte, atomic_load(&hugeExplicitFallbacks),
+            transparent / mebibyte, peak / mebibyte);
+}
+#endif
 
-    // Domestic students take precedence over international
-    if (studentA->status != studentB->status) {
-        return (studentA->status == 'D') ? -1 : 1;
+// The library returns -1 when it runs out of memory; the command gives up
+void checkMemory(int status) {
+    if (status < 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
     }
-
-    return 0;
 }
 
 // Merge function for MergeSort
@@ -197,8 +257,8 @@ void merge(void *arr, int left, int mid, int right, size_t size, int (*cmp)(cons
     int n1 = mid - left + 1;
     int n2 = right - mid;
 
-    void *L = malloc(n1 * size);
-    void *R = malloc(n2 * size);
+    void *L = rosterLargeAlloc(largeBuffers, n1 * size);
+    void *R = rosterLargeAlloc(largeBuffers, n2 * size);
 
     for (int i = 0; i < n1; i++) {
         memcpy((char *)L + i * size, (char *)arr + (left + i) * size, size);
@@ -231,8 +291,8 @@ void merge(void *arr, int left, int mid, int right, size_t size, int (*cmp)(cons
         k++;
     }
 
-    free(L);
-    free(R);
+    rosterLargeFree(largeBuffers, L);
+    rosterLargeFree(largeBuffers, R);
 }
 
 // MergeSort function
@@ -246,166 +306,3653 @@ void mergeSort(void *arr, int left, int right, size_t size, int (*cmp)(const voi
     }
 }
 
-void processFile(FILE *input, FILE *output, int option) {
-    char line[MAX_LINE_LENGTH];
+// Parse one input line; a rejected line's error goes to output and the validator's reason to stderr
+int parseStudentLine(const char *line, FILE *output, Student *student) {
+    char message[128], detail[256];
+    if (rosterParseStudentRecord(line, student, message, sizeof(message), detail, sizeof(detail))) {
+        return 1;
+    }
+    fputs(detail, stderr);
+    fputs(message, output);
+    return 0;
+}
 
-    // Arrays to store students
-    DomesticStudent domesticList[MAX_STUDENTS];
-    InternationalStudent internationalList[MAX_STUDENTS];
-    int domesticCount = 0, internationalCount = 0;
+// Line reader over large refillable blocks. Lines are handed out in place; a line that crosses
+// a block boundary is moved to the front of the buffer and the buffer only grows for lines
+// longer than a block, up to maxLineLength.
+typedef struct {
+    FILE *input;
+    char *buffer;
+    size_t capacity;        // one byte more is allocated for the terminator of a final unterminated line
+    size_t start, end;      // unread bytes are buffer[start..end)
+    size_t maxLineLength;
+    int atEnd;
+    long long base;         // input offset of buffer[0]
+    long long stopOffset;   // no line starting at or after this offset is returned; -1 for none
+} LineReader;
 
-    while (fgets(line, sizeof(line), input)) {
-        // Remove trailing newline character
-        line[strcspn(line, "\n")] = '\0';
+void lineReaderInit(LineReader *reader, FILE *input, size_t maxLineLength) {
+    memset(reader, 0, sizeof(*reader));
+    reader->input = input;
+    reader->maxLineLength = maxLineLength;
+    reader->stopOffset = -1;
+    reader->capacity = LINE_BLOCK_SIZE;
+    reader->buffer = malloc(reader->capacity + 1);
+    if (reader->buffer == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+}
 
-        char firstName[50], lastName[50], birthDigits[50];
-        float gpa = 0.0;
-        char status;
-        int toefl = -1;
-        int requiresTOEFL = 0;
+void lineReaderFree(LineReader *reader) {
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
 
-        //Validate the format of the line
-        if (!validateLineFormat(line, &requiresTOEFL)) {
-            // If validation fails, stop processing this line
-            fprintf(output, "Error: Invalid format\n");
-            continue;
+// Move the partial line to the front and read more input behind it
+void lineReaderRefill(LineReader *reader) {
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->base += reader->start;
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    if (reader->end == reader->capacity) {
+        size_t capacity = reader->capacity * 2;
+        char *grown = realloc(reader->buffer, capacity + 1);
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
         }
+        reader->buffer = grown;
+        reader->capacity = capacity;
+    }
+    size_t got = fread(reader->buffer + reader->end, 1, reader->capacity - reader->end, reader->input);
+    reader->end += got;
+    if (got == 0) {
+        reader->atEnd = 1;
+    }
+}
 
-        // Parse the line based on whether TOEFL is required or not
-        int fieldsRead;
-        if (requiresTOEFL) {
-            fieldsRead = sscanf(line, "%49s %49s %49s %f %c %d", firstName, lastName, birthDigits, &gpa, &status, &toefl);
-        } else {
-            fieldsRead = sscanf(line, "%49s %49s %49s %f %c", firstName, lastName, birthDigits, &gpa, &status);
+// Next line without its newline, NUL-terminated in place. Returns 1 for a line, 0 at end of input,
+// and -1 for a line longer than maxLineLength, which is skipped entirely.
+int lineReaderNext(LineReader *reader, char **line, size_t *length) {
+    size_t scanned = 0;   // bytes of the pending line already searched for a newline
+    int oversized = 0;
+
+    if (reader->stopOffset >= 0 && reader->base + (long long)reader->start >= reader->stopOffset) {
+        return 0;
+    }
+
+    for (;;) {
+        char *begin = reader->buffer + reader->start;
+        size_t available = reader->end - reader->start;
+        char *newline = memchr(begin + scanned, '\n', available - scanned);
+
+        if (newline != NULL) {
+            size_t lineLength = (size_t)(newline - begin);
+            reader->start += lineLength + 1;
+            if (oversized || lineLength > reader->maxLineLength) {
+                return -1;
+            }
+            *newline = '\0';
+            *line = begin;
+            *length = lineLength;
+            return 1;
+        }
+        if (reader->atEnd) {
+            if (available == 0 && !oversized) {
+                return 0;
+            }
+            reader->start = reader->end;
+            if (oversized || available > reader->maxLineLength) {
+                return -1;
+            }
+            begin[available] = '\0';
+            *line = begin;
+            *length = available;
+            return 1;
         }
 
-        // Extract day, month, and year from birthDigits
-        int day = 0, month = 0, year = 0;
-        divideBirthDigits(birthDigits, &day, &month, &year);
+        // Past the limit: drop what was read of this line instead of growing the buffer further
+        if (available > reader->maxLineLength) {
+            oversized = 1;
+            reader->start = reader->end;
+            available = 0;
+        }
+        scanned = available;
+        lineReaderRefill(reader);
+    }
+}
 
-        // Ensure valid month and year ranges
-        if (month == -1 || year < 1950 || year > 2010) {
-            fprintf(output, "Error: Invalid birth date\n");
-            continue;
+// Restrict the reader to the lines that start in [start, stop) of a seekable input
+int lineReaderSetRange(LineReader *reader, long long start, long long stop) {
+    long long from = start > 0 ? start - 1 : 0;
+    if (fseeko(reader->input, (off_t)from, SEEK_SET) != 0) {
+        return 0;
+    }
+    reader->start = reader->end = 0;
+    reader->base = from;
+    reader->atEnd = 0;
+    reader->stopOffset = stop;
+    if (start > 0) {
+        // The line holding byte start - 1 belongs to the previous range; if that byte is the
+        // newline this skips an empty line and the range begins exactly at start
+        char *line;
+        size_t length;
+        lineReaderNext(reader, &line, &length);
+    }
+    return 1;
+}
+
+void reportOversizedLine(FILE *errors, size_t maxLineLength) {
+    fprintf(errors, "Error: Line too long - exceeds %zu bytes\n", maxLineLength);
+}
+
+// Read the lines of input that start in the byte range [rangeStart, rangeStop) into the roster
+// (rangeStop -1 reads to the end); rejected lines are reported to errors. Returns 0 if the
+// input cannot be positioned at the range.
+int loadRosterRange(FILE *input, FILE *errors, Roster *roster, size_t maxLineLength, long long rangeStart,
+                    long long rangeStop) {
+    LineReader reader;
+    Student student;
+    char *line;
+    size_t length;
+    int status;
+
+    lineReaderInit(&reader, input, maxLineLength);
+    if ((rangeStart > 0 || rangeStop >= 0) && !lineReaderSetRange(&reader, rangeStart, rangeStop)) {
+        lineReaderFree(&reader);
+        return 0;
+    }
+    while ((status = lineReaderNext(&reader, &line, &length)) != 0) {
+        if (status < 0) {
+            reportOversizedLine(errors, maxLineLength);
+        } else if (parseStudentLine(line, errors, &student)) {
+            checkMemory(rosterAdd(roster, &student));
         }
+    }
+    lineReaderFree(&reader);
+    return 1;
+}
 
-        // Check if the status is 'I' or 'D'
-        if (status != 'I' && status != 'D') {
-            fprintf(output, "Error: Invalid status - Expected 'I' or 'D'\n");
-            continue;
+// Read every line of input into the roster; rejected lines are reported to errors
+void loadRoster(FILE *input, FILE *errors, Roster *roster, size_t maxLineLength) {
+    loadRosterRange(input, errors, roster, maxLineLength, 0, -1);
+}
+
+// Rejected lines reported by the library: the reason goes to stderr, the error where the format puts it
+void writeRejectedLine(void *user, const char *message, int detail) {
+    fputs(message, detail ? stderr : (FILE *)user);
+}
+
+#ifndef _WIN32
+// Parallel formatting of the sorted output: each round gives every worker one contiguous slice of up
+// to FORMAT_SLICE_RECORDS records to format into its own buffer, then the buffers are written in order
+#define FORMAT_SLICE_RECORDS (1 << 16)
+#define FORMAT_MAX_WORKERS 16
+
+typedef struct {
+    const Student *students;
+    int count;
+    RecordWriter writer;
+} FormatSlice;
+
+void *formatSliceWorker(void *arg) {
+    FormatSlice *slice = arg;
+    for (int i = 0; i < slice->count; i++) {
+        rosterRecordWriterAdd(&slice->writer, &slice->students[i]);
+    }
+    return NULL;
+}
+
+// Write the buffers in order: gathered writev calls on a descriptor, stdio for streams without one.
+// A failed write ends the program, as the rest of the output would be lost too
+void writeBuffers(FILE *output, int fd, struct iovec *parts, int partCount) {
+    if (fd < 0) {
+        for (int i = 0; i < partCount; i++) {
+            if (fwrite(parts[i].iov_base, 1, parts[i].iov_len, output) != parts[i].iov_len) {
+                fprintf(stderr, "Error: Could not write output file\n");
+                exit(1);
+            }
+        }
+        return;
+    }
+    while (partCount > 0) {
+        ssize_t written = writev(fd, parts, partCount);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error: Could not write output file\n");
+            exit(1);
         }
+        // Drop what was written, resuming inside a partly written buffer
+        while (partCount > 0 && (size_t)written >= parts->iov_len) {
+            written -= (ssize_t)parts->iov_len;
+            parts++;
+            partCount--;
+        }
+        if (partCount > 0) {
+            parts->iov_base = (char *)parts->iov_base + written;
+            parts->iov_len -= (size_t)written;
+        }
+    }
+}
 
-        // Format the birth date once here
-        char formattedBirthDigits[50];
-        snprintf(formattedBirthDigits, sizeof(formattedBirthDigits), "%s-%d-%d", getMonthAbbreviation(month), day, year);
+// Format the students on up to workers threads; the bytes are the same as one RecordWriter's
+void writeStudentsParallel(FILE *output, const Student *students, int count, int format, int workers) {
+    FormatSlice slices[FORMAT_MAX_WORKERS];
+    pthread_t threads[FORMAT_MAX_WORKERS];
+    int started[FORMAT_MAX_WORKERS];
+    struct iovec parts[FORMAT_MAX_WORKERS];
+    OutputBuffer pool = {NULL, 0, 0, 0};   // binary format: every slice's names, written after the records
+    unsigned long long poolLength = 0;
 
-        // Handle domestic students
-        if (status == 'D') {
-            if (fieldsRead > 5) {
-                fprintf(output, "Error: Extra arguments found for domestic student\n");
-                continue;
+    // Descriptor writes bypass the stream, so what it holds goes first; io_uring streams have no descriptor
+    fflush(output);
+    int fd = fileno(output);
+
+    RecordWriter header;
+    rosterRecordWriterInit(&header, NULL, format);
+    checkMemory(rosterRecordWriterFlush(&header));
+    parts[0].iov_base = header.buffer.data;
+    parts[0].iov_len = header.buffer.length;
+    writeBuffers(output, fd, parts, header.buffer.length > 0 ? 1 : 0);
+    free(header.buffer.data);
+
+    for (int first = 0; first < count;) {
+        int used = 0;
+        for (; used < workers && first < count; used++) {
+            FormatSlice *slice = &slices[used];
+            slice->students = students + first;
+            slice->count = count - first < FORMAT_SLICE_RECORDS ? count - first : FORMAT_SLICE_RECORDS;
+            rosterRecordWriterInitSlice(&slice->writer, format, poolLength);
+            if (format == FORMAT_BINARY) {
+                // Name offsets continue from the slices before
+                for (int i = 0; i < slice->count; i++) {
+                    poolLength += strlen(slice->students[i].firstName) + strlen(slice->students[i].lastName) + 2;
+                }
             }
-            DomesticStudent ds;
-            strcpy(ds.firstName, firstName);
-            strcpy(ds.lastName, lastName);
-            strcpy(ds.birthDigits, formattedBirthDigits);
-            ds.day = day;
-            ds.month = month;
-            ds.year = year;
-            ds.gpa = gpa;
-            ds.status = status;
-            domesticList[domesticCount++] = ds;
-        }
-        // Handle international students
-        else if (status == 'I' && requiresTOEFL) {
-            if (fieldsRead != 6) {
-                fprintf(output, "Error: Missing TOEFL score for international student\n");
-                continue;
+            first += slice->count;
+            // Without a thread the slice is formatted here, which only costs the parallelism
+            started[used] = pthread_create(&threads[used], NULL, formatSliceWorker, slice) == 0;
+            if (!started[used]) formatSliceWorker(slice);
+        }
+        for (int i = 0; i < used; i++) {
+            if (started[i]) pthread_join(threads[i], NULL);
+            checkMemory(rosterRecordWriterFlush(&slices[i].writer));
+            parts[i].iov_base = slices[i].writer.buffer.data;
+            parts[i].iov_len = slices[i].writer.buffer.length;
+        }
+        writeBuffers(output, fd, parts, used);
+        for (int i = 0; i < used; i++) {
+            if (slices[i].writer.pool.length > 0) {
+                rosterAppendBytes(&pool, slices[i].writer.pool.data, slices[i].writer.pool.length);
             }
-            InternationalStudent is;
-            strcpy(is.firstName, firstName);
-            strcpy(is.lastName, lastName);
-            strcpy(is.birthDigits, formattedBirthDigits);
-            is.day = day;
-            is.month = month;
-            is.year = year;
-            is.gpa = gpa;
-            is.status = status;
-            is.toefl = toefl;
-            internationalList[internationalCount++] = is;
+            free(slices[i].writer.buffer.data);
+            free(slices[i].writer.pool.data);
         }
     }
 
-    // Sort and output based on the given option
-    if (option == 1) {
-        mergeSort(domesticList, 0, domesticCount - 1, sizeof(DomesticStudent), compareStudents);
-        for (int i = 0; i < domesticCount; i++) {
-            fprintf(output, "%s %s %.3f %s %c\n",
-                    domesticList[i].firstName, domesticList[i].lastName,
-                    domesticList[i].gpa, domesticList[i].birthDigits,
-                    domesticList[i].status);
+    if (format == FORMAT_BINARY) {
+        rosterAppendLittleEndian(&pool, (unsigned long long)count, 8);
+        rosterAppendLittleEndian(&pool, poolLength, 8);
+        checkMemory(pool.failed ? -1 : 0);
+        parts[0].iov_base = pool.data;
+        parts[0].iov_len = pool.length;
+        writeBuffers(output, fd, parts, 1);
+    }
+    free(pool.data);
+}
+#endif
+
+// The plain sorted output, through libroster
+int processFile(FILE *input, FILE *output, const Options *options) {
+    RosterContext *context = rosterContextCreate();
+    char *block = malloc(LINE_BLOCK_SIZE);
+    if (context == NULL || block == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    if (largeBuffers != NULL) {
+        checkMemory(rosterContextSetAllocator(context, largeBuffers->allocate, largeBuffers->release));
+    }
+    rosterContextSetOption(context, options->option);
+    rosterContextSetFormat(context, options->format);
+    checkMemory(rosterContextSetDedup(context, options->dedup));
+    rosterContextSetMaxLineLength(context, options->maxLineLength);
+    if (options->sortSpec != NULL) {
+        rosterContextSetSortBy(context, options->sortSpec);
+    }
+    // Rejected-line messages stay inline only in the text format
+    FILE *errors = options->format == FORMAT_TEXT ? output : stderr;
+    rosterContextSetErrorHandler(context, writeRejectedLine, errors);
+
+    if (options->shardCount > 0) {
+        // A shard reads the lines that start in its share of the input bytes
+        long long size = fseeko(input, 0, SEEK_END) == 0 ? (long long)ftello(input) : -1;
+        LineReader reader;
+        lineReaderInit(&reader, input, options->maxLineLength);
+        if (size < 0 || !lineReaderSetRange(&reader, size * options->shardIndex / options->shardCount,
+                                            size * (options->shardIndex + 1) / options->shardCount)) {
+            fprintf(stderr, "Error: --shard needs a seekable input file\n");
+            lineReaderFree(&reader);
+            rosterContextDestroy(context);
+            free(block);
+            return 1;
         }
-    } else if (option == 2) {
-        mergeSort(internationalList, 0, internationalCount - 1, sizeof(InternationalStudent), compareStudents);
-        for (int i = 0; i < internationalCount; i++) {
-            fprintf(output, "%s %s %.3f %s %c %d\n",
-                    internationalList[i].firstName, internationalList[i].lastName,
-                    internationalList[i].gpa, internationalList[i].birthDigits,
-                    internationalList[i].status, internationalList[i].toefl);
+        char *line;
+        size_t length;
+        int status;
+        while ((status = lineReaderNext(&reader, &line, &length)) != 0) {
+            if (status < 0) {
+                reportOversizedLine(errors, options->maxLineLength);
+            } else {
+                checkMemory(rosterContextAddLine(context, line, length));
+            }
         }
-    } else if (option == 3) {
-        mergeSort(domesticList, 0, domesticCount - 1, sizeof(DomesticStudent), compareStudents);
-        mergeSort(internationalList, 0, internationalCount - 1, sizeof(InternationalStudent), compareStudents);
-
-        for (int i = 0; i < domesticCount; i++) {
-            fprintf(output, "%s %s %.3f %s %c\n",
-                    domesticList[i].firstName, domesticList[i].lastName,
-                    domesticList[i].gpa, domesticList[i].birthDigits,
-                    domesticList[i].status);
+        lineReaderFree(&reader);
+    } else {
+        size_t got;
+        while ((got = fread(block, 1, LINE_BLOCK_SIZE, input)) > 0) {
+            checkMemory(rosterContextFeed(context, block, got));
         }
-        for (int i = 0; i < internationalCount; i++) {
-            fprintf(output, "%s %s %.3f %s %c %d\n",
-                    internationalList[i].firstName, internationalList[i].lastName,
-                    internationalList[i].gpa, internationalList[i].birthDigits,
-                    internationalList[i].status, internationalList[i].toefl);
+    }
+
+    int count = rosterContextSort(context);
+    checkMemory(count);
+#ifndef _WIN32
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = cores < FORMAT_MAX_WORKERS ? (int)cores : FORMAT_MAX_WORKERS;
+    if (workers > 1 && count >= 2 * FORMAT_SLICE_RECORDS) {
+        writeStudentsParallel(output, rosterContextStudents(context, &count), count, options->format, workers);
+        rosterContextDestroy(context);
+        free(block);
+        return 0;
+    }
+#endif
+    size_t ready;
+    while ((ready = rosterContextSerialize(context, block, LINE_BLOCK_SIZE)) > 0) {
+        checkMemory(ready == (size_t)-1 ? -1 : 0);
+        fwrite(block, 1, ready, output);
+    }
+
+    rosterContextDestroy(context);
+    free(block);
+    return 0;
+}
+
+double elapsedMilliseconds(const struct timespec *start) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// --bench-sort: time the generic mergeSort against the specialized sort on the loaded roster
+void benchmarkSorts(FILE *input, FILE *output, const Options *options) {
+    Roster roster;
+    checkMemory(rosterInit(&roster, largeBuffers));
+    loadRoster(input, stderr, &roster, options->maxLineLength);
+
+    size_t bytes = roster.count * sizeof(Student);
+    Student *generic = rosterLargeAlloc(largeBuffers, bytes + sizeof(Student));
+    Student *specialized = rosterLargeAlloc(largeBuffers, bytes + sizeof(Student));
+    if (generic == NULL || specialized == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+
+    double genericTime = 0, specializedTime = 0;
+    int identical = 1;
+    struct timespec start;
+    for (int round = 0; round < options->benchRounds; round++) {
+        memcpy(generic, roster.students, bytes);
+        memcpy(specialized, roster.students, bytes);
+        timespec_get(&start, TIME_UTC);
+        mergeSort(generic, 0, roster.count - 1, sizeof(Student), rosterCompareStudents);
+        genericTime += elapsedMilliseconds(&start);
+        timespec_get(&start, TIME_UTC);
+        checkMemory(rosterSortStudents(specialized, roster.count, NULL, largeBuffers));
+        specializedTime += elapsedMilliseconds(&start);
+        identical &= memcmp(generic, specialized, roster.count * sizeof(Student)) == 0;
+    }
+
+    int rounds = options->benchRounds;
+    fprintf(output, "%d records: mergeSort %.3f ms, specialized %.3f ms, speedup %.2fx\n", roster.count,
+            genericTime / rounds, specializedTime / rounds, specializedTime > 0 ? genericTime / specializedTime : 0.0);
+    fprintf(output, "orders %s\n", identical ? "identical" : "DIFFER");
+
+    rosterLargeFree(largeBuffers, generic);
+    rosterLargeFree(largeBuffers, specialized);
+    rosterFree(&roster);
+}
+
+#define AGG_FIRST_YEAR 1950
+#define AGG_YEARS 61            // 1950..2010, the accepted birth years
+
+// Smallest GPA such that at least percent% of the count students are at or below it (nearest rank)
+double histogramPercentile(const int *histogram, long long count, int percent) {
+    long long rank = (count * percent + 99) / 100;
+    if (rank < 1) rank = 1;
+    long long seen = 0;
+    for (int i = 0; i < GPA_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen >= rank) return i / 1000.0;
+    }
+    return (GPA_BUCKETS - 1) / 1000.0;
+}
+
+// --percentile/--rank: a GPA histogram at the printed precision over the option's students, or only
+// those born in year (0 for every year). One linear pass, no sort and no date index.
+int buildGpaHistogram(const Roster *roster, int option, int year, int *histogram) {
+    int total = 0;
+
+    memset(histogram, 0, GPA_BUCKETS * sizeof(int));
+    for (int i = 0; i < roster->count; i++) {
+        const Student *s = &roster->students[i];
+        if (rosterOptionIncludes(option, s) && (year == 0 || s->year == year)) {
+            histogram[rosterGpaBucket(s->gpa)]++;
+            total++;
         }
     }
+    return total;
 }
 
-int main(int argc, char *argv[]) {
-    if (argc < 4) {
-        printf("Error: Insufficient arguments\n");
+// Parse "P[,YYYY]" or "LastName,FirstName[,YYYY]" scopes; the year is 0 when not given
+int parseQueryYear(const char *text, int *year) {
+    *year = 0;
+    if (text == NULL) {
         return 1;
     }
+    char *end;
+    long value = strtol(text + 1, &end, 10);
+    if (*end != '\0' || value < AGG_FIRST_YEAR || value >= AGG_FIRST_YEAR + AGG_YEARS) {
+        return 0;
+    }
+    *year = (int)value;
+    return 1;
+}
 
-    // Open input and output files
-    FILE *inputFile = fopen(argv[1], "r");
-    if (inputFile == NULL) {
-        printf("Error: Could not open input file\n");
-        return 1;
+void writeQueryScope(FILE *output, int option, int year) {
+    const char *statuses[] = {"", "domestic", "international", "all"};
+    fprintf(output, "%s students", statuses[option]);
+    if (year != 0) {
+        fprintf(output, " born in %d", year);
+    }
+}
+
+// --percentile=P[,YYYY]: the GPA at the P-th percentile
+int answerPercentile(const Roster *roster, int option, const char *spec, int *histogram, FILE *output) {
+    char *end;
+    long percent = strtol(spec, &end, 10);
+    int year;
+    if (end == spec || (*end != '\0' && *end != ',') || percent < 0 || percent > 100 ||
+        !parseQueryYear(*end == ',' ? end : NULL, &year)) {
+        return 0;
     }
 
-    FILE *outputFile = fopen(argv[2], "w");
-    if (outputFile == NULL) {
-        printf("Error: Could not open output file\n");
-        fclose(inputFile);
-        return 1;
+    int total = buildGpaHistogram(roster, option, year, histogram);
+    fprintf(output, "GPA percentile %ld of ", percent);
+    writeQueryScope(output, option, year);
+    if (total == 0) {
+        fprintf(output, ": no students\n");
+    } else {
+        fprintf(output, " (%d): %.3f\n", total, histogramPercentile(histogram, total, (int)percent));
     }
+    return 1;
+}
 
-    // Get option from command line argument
-    int option = atoi(argv[3]);
-    if (option < 1 || option > 3) {
-        fprintf(outputFile, "Error: Invalid option\n");
-        fclose(inputFile);
-        fclose(outputFile);
-        return 1;
+// --rank=LastName,FirstName[,YYYY]: GPA rank of each student with that name, 1 for the highest GPA;
+// students with the same GPA at the printed precision share a rank
+int answerRank(const Roster *roster, int option, const char *spec, int *histogram, FILE *output) {
+    char lastName[50], firstName[50];
+    int length = 0, year;
+    if (sscanf(spec, "%49[^,],%49[^,]%n", lastName, firstName, &length) != 2 ||
+        !parseQueryYear(spec[length] == ',' ? spec + length : NULL, &year) || (spec[length] != '\0' && year == 0)) {
+        return 0;
     }
 
-    // Process the file based on the given option
-    processFile(inputFile, outputFile, option);
+    int total = buildGpaHistogram(roster, option, year, histogram);
+    // above[b]: students with a GPA bucket above b
+    int above = 0, found = 0;
+    for (int b = GPA_BUCKETS - 1; b >= 0; b--) {
+        int count = histogram[b];
+        histogram[b] = above;
+        above += count;
+    }
 
-    fclose(inputFile);
-    fclose(outputFile);
+    // Matches are reported in the sorted order, like --lookup
+    Student *matches;
+    found = rosterIndexFindName(roster, option, lastName, firstName, year, &matches);
+    checkMemory(found);
+
+    for (int i = 0; i < found; i++) {
+        const Student *s = &matches[i];
+        fprintf(output, "GPA rank of %s %s %s-%d-%d %c: %d of %d ", s->firstName, s->lastName,
+                rosterMonthAbbreviation(s->month), s->day, s->year, s->status, histogram[rosterGpaBucket(s->gpa)] + 1,
+                total);
+        writeQueryScope(output, option, year);
+        fprintf(output, "\n");
+    }
+    free(matches);
+    if (found == 0) {
+        fprintf(output, "GPA rank of %s %s: not found among ", firstName, lastName);
+        writeQueryScope(output, option, year);
+        fprintf(output, "\n");
+    }
+    return 1;
+}
+
+// Answer --lookup/--range/--percentile/--rank queries from the index instead of writing the whole sorted roster
+int processQueries(FILE *input, FILE *output, const Options *options) {
+    int option = options->option;
+    int queryCount = options->queryCount;
+    char **queries = options->queries;
+    Roster roster;
+    checkMemory(rosterInit(&roster, largeBuffers));
+    checkMemory(rosterEnableDedup(&roster, options->dedup));
+    checkMemory(rosterEnableIndex(&roster));
+
+    // Rejected lines go to stderr so the output only holds query answers
+    loadRoster(input, stderr, &roster, options->maxLineLength);
+    // Only --range needs the records in birth date order; the other queries go through the name hash or a linear pass
+    for (int i = 0; i < queryCount; i++) {
+        if (strncmp(queries[i], "--range=", 8) == 0) {
+            checkMemory(rosterIndexBuildDateOrder(&roster));
+            break;
+        }
+    }
+
+    RecordWriter writer;
+    rosterRecordWriterInit(&writer, output, options->format);
+    FILE *messages = options->format == FORMAT_TEXT ? output : stderr;
+    int *histogram = malloc(GPA_BUCKETS * sizeof(int));
+    if (histogram == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+
+    int status = 0;
+    for (int i = 0; i < queryCount; i++) {
+        if (strncmp(queries[i], "--percentile=", 13) == 0 || strncmp(queries[i], "--rank=", 7) == 0) {
+            int percentile = queries[i][2] == 'p';
+            checkMemory(rosterRecordWriterFlush(&writer));
+            if (percentile ? !answerPercentile(&roster, option, queries[i] + 13, histogram, output)
+                           : !answerRank(&roster, option, queries[i] + 7, histogram, output)) {
+                fprintf(messages, percentile ? "Error: Invalid percentile - Expected --percentile=P[,YYYY] with P from 0 to 100\n"
+                                             : "Error: Invalid rank - Expected --rank=LastName,FirstName[,YYYY]\n");
+                status = 1;
+            }
+        } else if (strncmp(queries[i], "--lookup=", 9) == 0) {
+            char lastName[50], firstName[50];
+            if (sscanf(queries[i] + 9, "%49[^,],%49s", lastName, firstName) != 2) {
+                checkMemory(rosterRecordWriterFlush(&writer));
+                fprintf(messages, "Error: Invalid lookup - Expected --lookup=LastName,FirstName\n");
+                status = 1;
+                continue;
+            }
+            checkMemory(rosterQueryByName(&roster, &writer, option, lastName, firstName));
+        } else {
+            char fromText[50], toText[50];
+            int fromKey = -1, toKey = -1;
+            if (sscanf(queries[i] + 8, "%49[^,],%49s", fromText, toText) == 2) {
+                fromKey = rosterParseDateKey(fromText);
+                toKey = rosterParseDateKey(toText);
+            }
+            if (fromKey == -1 || toKey == -1) {
+                checkMemory(rosterRecordWriterFlush(&writer));
+                fprintf(messages, "Error: Invalid range - Expected --range=Mon-D-YYYY,Mon-D-YYYY\n");
+                status = 1;
+                continue;
+            }
+            checkMemory(rosterQueryByDateRange(&roster, &writer, option, fromKey, toKey));
+        }
+    }
+    checkMemory(rosterRecordWriterFinish(&writer));
+
+    free(histogram);
+    rosterFree(&roster);
+    return status;
+}
+
+#ifndef _WIN32
+// Pipelined execution: reader thread -> parser workers -> merging thread -> writer thread,
+// connected by single-producer/single-consumer lock-free rings
+#define PIPELINE_BLOCK_SIZE (1 << 20)
+#define PIPELINE_RING_SIZE 16
+#define PIPELINE_WRITE_BATCH 4096
+
+typedef struct {
+    void **items;
+    size_t mask;            // capacity - 1, capacity is a power of two
+    _Atomic size_t head;    // next slot the consumer pops
+    _Atomic size_t tail;    // next slot the producer fills
+} SpscRing;
+
+void ringInit(SpscRing *ring, size_t capacity) {
+    ring->items = malloc(capacity * sizeof(void *));
+    if (ring->items == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    ring->mask = capacity - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+void ringPush(SpscRing *ring, void *item) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) > ring->mask) {
+        sched_yield();
+    }
+    ring->items[tail & ring->mask] = item;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+void *ringPop(SpscRing *ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (atomic_load_explicit(&ring->tail, memory_order_acquire) == head) {
+        sched_yield();
+    }
+    void *item = ring->items[head & ring->mask];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return item;
+}
+
+// A line-aligned slice of the input
+typedef struct {
+    char *data;
+    size_t length;
+} InputBlock;
+
+// One parsed block: its rejected-line messages and its records, already sorted into a run
+typedef struct {
+    char *errors;
+    size_t errorsLength;
+    Student *records;
+    int count;
+} ParsedBatch;
+
+// Work handed to the writer thread, in output order
+typedef struct {
+    const char *text;           // rejected-line messages, or NULL for records
+    size_t textLength;
+    const Student *records[PIPELINE_WRITE_BATCH];
+    int recordCount;
+} WriteChunk;
+
+typedef struct {
+    SpscRing in, out;
+    int option;
+    size_t maxLineLength;
+} ParserContext;
+
+typedef struct {
+    FILE *input;
+    ParserContext *parsers;  // blocks are dealt round-robin, so block n goes to parser n % parserCount
+    int parserCount;
+} ReaderContext;
+
+typedef struct {
+    RecordWriter writer;
+    SpscRing in;
+} WriterContext;
+
+void *pipelineReader(void *arg) {
+    ReaderContext *context = arg;
+    size_t maxLineLength = context->parsers[0].maxLineLength;
+    size_t carry = 0, capacity = PIPELINE_BLOCK_SIZE;
+    char *buffer = malloc(capacity + 1);   // spare byte terminates an unterminated last line
+    long sequence = 0;
+    int skipping = 0;                      // dropping the rest of a line longer than maxLineLength
+
+    for (;;) {
+        if (buffer == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        size_t got = fread(buffer + carry, 1, capacity - carry, context->input);
+        size_t filled = carry + got;
+        int atEnd = got == 0;
+
+        if (skipping) {
+            char *newline = memchr(buffer + carry, '\n', got);
+            if (newline == NULL && !atEnd) {
+                continue;
+            }
+            if (newline != NULL) {
+                size_t rest = filled - (size_t)(newline - buffer);
+                memmove(buffer + carry, newline, rest);
+                filled = carry + rest;
+            }
+            skipping = 0;
+        }
+
+        // Hand over everything up to the last newline; keep the partial line for the next block
+        size_t cut = filled;
+        if (!atEnd) {
+            while (cut > 0 && buffer[cut - 1] != '\n') cut--;
+            if (cut == 0) {
+                if (filled > maxLineLength) {
+                    // Keep just enough of the line for the parser to reject it, like LineReader
+                    carry = maxLineLength + 1;
+                    skipping = 1;
+                } else {
+                    carry = filled;
+                }
+                // A line larger than the block: grow, up to the longest line allowed plus a block
+                if (capacity - carry < PIPELINE_BLOCK_SIZE / 2) {
+                    size_t limit = maxLineLength + 1 + PIPELINE_BLOCK_SIZE;
+                    capacity = capacity * 2 < limit ? capacity * 2 : limit;
+                    char *grown = realloc(buffer, capacity + 1);
+                    if (grown == NULL) {
+                        free(buffer);
+                    }
+                    buffer = grown;
+                }
+                continue;
+            }
+        }
+        if (cut > 0) {
+            InputBlock *block = malloc(sizeof(InputBlock));
+            char *next = malloc(capacity + 1);
+            if (block == NULL || next == NULL) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(1);
+            }
+            memcpy(next, buffer + cut, filled - cut);
+            block->data = buffer;
+            block->length = cut;
+            ringPush(&context->parsers[sequence++ % context->parserCount].in, block);
+            buffer = next;
+        }
+        carry = filled - cut;
+        if (atEnd) break;
+    }
+
+    free(buffer);
+    for (int i = 0; i < context->parserCount; i++) {
+        ringPush(&context->parsers[i].in, NULL);
+    }
+    return NULL;
+}
+
+// Parse the lines of a block in place, with the same rules as LineReader; only the records
+// the output option includes are kept
+void parseBlock(InputBlock *block, FILE *errors, const ParserContext *context, ParsedBatch *batch) {
+    char *position = block->data;
+    char *end = block->data + block->length;
+    size_t maxLineLength = context->maxLineLength;
+    Student student;
+
+    while (position < end) {
+        char *newline = memchr(position, '\n', end - position);
+        char *line = position;
+        size_t length = newline ? (size_t)(newline - position) : (size_t)(end - position);
+
+        // The reader leaves a spare byte after every block for an unterminated last line
+        line[length] = '\0';
+        position += length + 1;
+
+        if (length > maxLineLength) {
+            reportOversizedLine(errors, maxLineLength);
+        } else if (parseStudentLine(line, errors, &student) && rosterOptionIncludes(context->option, &student)) {
+            batch->records[batch->count++] = student;
+        }
+    }
+}
+
+void *pipelineParser(void *arg) {
+    ParserContext *context = arg;
+    InputBlock *block;
+
+    while ((block = ringPop(&context->in)) != NULL) {
+        ParsedBatch *batch = calloc(1, sizeof(ParsedBatch));
+        size_t lines = 1;
+        for (size_t i = 0; i < block->length; i++) {
+            if (block->data[i] == '\n') lines++;
+        }
+        // Allocated and first written here, so the pages land on this parser's node
+        batch->records = rosterLargeAlloc(largeBuffers, lines * sizeof(Student));
+        FILE *errors = open_memstream(&batch->errors, &batch->errorsLength);
+        if (batch->records == NULL || errors == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+
+        parseBlock(block, errors, context, batch);
+        fclose(errors);
+        free(block->data);
+        free(block);
+
+        // Run generation: each batch leaves the parser as a sorted run
+        checkMemory(rosterSortStudents(batch->records, batch->count, NULL, largeBuffers));
+        ringPush(&context->out, batch);
+    }
+
+    ringPush(&context->out, NULL);
+    return NULL;
+}
+
+void *pipelineWriter(void *arg) {
+    WriterContext *context = arg;
+    WriteChunk *chunk;
+
+    while ((chunk = ringPop(&context->in)) != NULL) {
+        if (chunk->text != NULL) {
+            checkMemory(rosterRecordWriterFlush(&context->writer));
+            fwrite(chunk->text, 1, chunk->textLength, context->writer.file);
+        } else {
+            for (int i = 0; i < chunk->recordCount; i++) {
+                rosterRecordWriterAdd(&context->writer, chunk->records[i]);
+            }
+        }
+        free(chunk);
+    }
+    return NULL;
+}
+
+// Stable k-way merge of sorted runs; equal records are taken from the earlier run first
+void mergeRunsToWriter(ParsedBatch **batches, int batchCount, SpscRing *toWriter) {
+    int *heap = malloc((batchCount + 1) * sizeof(int));
+    int *cursor = calloc(batchCount + 1, sizeof(int));
+    int heapSize = 0;
+    if (heap == NULL || cursor == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+
+#define RUN_COUNT(b) (batches[b]->count)
+#define RUN_HEAD(b) (&batches[b]->records[cursor[b]])
+#define RUN_COMPARE(x, y) compareStudentRecords(NULL, RUN_HEAD(x), RUN_HEAD(y))
+#define RUN_LESS(x, y) (RUN_COMPARE(x, y) < 0 || (RUN_COMPARE(x, y) == 0 && (x) < (y)))
+
+    for (int b = 0; b < batchCount; b++) {
+        if (RUN_COUNT(b) == 0) continue;
+        int child = heapSize++;
+        heap[child] = b;
+        while (child > 0 && RUN_LESS(heap[child], heap[(child - 1) / 2])) {
+            int swap = heap[child]; heap[child] = heap[(child - 1) / 2]; heap[(child - 1) / 2] = swap;
+            child = (child - 1) / 2;
+        }
+    }
+
+    WriteChunk *chunk = NULL;
+    while (heapSize > 0) {
+        int b = heap[0];
+        if (chunk == NULL) {
+            chunk = calloc(1, sizeof(WriteChunk));
+        }
+        chunk->records[chunk->recordCount++] = RUN_HEAD(b);
+        if (chunk->recordCount == PIPELINE_WRITE_BATCH) {
+            ringPush(toWriter, chunk);
+            chunk = NULL;
+        }
+
+        if (++cursor[b] == RUN_COUNT(b)) {
+            heap[0] = heap[--heapSize];
+        }
+        int parent = 0;
+        for (;;) {
+            int smallest = parent, left = 2 * parent + 1, right = left + 1;
+            if (left < heapSize && RUN_LESS(heap[left], heap[smallest])) smallest = left;
+            if (right < heapSize && RUN_LESS(heap[right], heap[smallest])) smallest = right;
+            if (smallest == parent) break;
+            int swap = heap[parent]; heap[parent] = heap[smallest]; heap[smallest] = swap;
+            parent = smallest;
+        }
+    }
+    if (chunk != NULL) {
+        ringPush(toWriter, chunk);
+    }
+
+#undef RUN_COUNT
+#undef RUN_HEAD
+#undef RUN_COMPARE
+#undef RUN_LESS
+    free(heap);
+    free(cursor);
+}
+
+// Same output as processFile, with reading, parsing/run generation, merging and writing overlapped
+void processFilePipelined(FILE *input, FILE *output, const Options *options) {
+    int parserCount = options->pipelineWorkers;
+    ParserContext *parsers = calloc(parserCount, sizeof(ParserContext));
+    pthread_t *parserThreads = calloc(parserCount, sizeof(pthread_t));
+    if (parsers == NULL || parserThreads == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+
+    ReaderContext reader = {input, parsers, parserCount};
+    WriterContext writer;
+    pthread_t readerThread, writerThread;
+    rosterRecordWriterInit(&writer.writer, output, options->format);
+    ringInit(&writer.in, PIPELINE_RING_SIZE);
+    for (int i = 0; i < parserCount; i++) {
+        ringInit(&parsers[i].in, PIPELINE_RING_SIZE);
+        ringInit(&parsers[i].out, PIPELINE_RING_SIZE);
+        parsers[i].option = options->option;
+        parsers[i].maxLineLength = options->maxLineLength;
+        pthread_create(&parserThreads[i], NULL, pipelineParser, &parsers[i]);
+    }
+    pthread_create(&readerThread, NULL, pipelineReader, &reader);
+    pthread_create(&writerThread, NULL, pipelineWriter, &writer);
+
+    // Collect batches in input order; rejected-line messages are forwarded as soon as they arrive
+    int batchCount = 0, batchCapacity = 64;
+    ParsedBatch **batches = malloc(batchCapacity * sizeof(ParsedBatch *));
+    for (int next = 0;; next++) {
+        ParsedBatch *batch = ringPop(&parsers[next % parserCount].out);
+        if (batch == NULL) break;
+        if (batchCount == batchCapacity) {
+            batchCapacity *= 2;
+            batches = realloc(batches, batchCapacity * sizeof(ParsedBatch *));
+        }
+        if (batches == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        batches[batchCount++] = batch;
+        if (batch->errorsLength > 0 && options->format != FORMAT_TEXT) {
+            fwrite(batch->errors, 1, batch->errorsLength, stderr);
+        } else if (batch->errorsLength > 0) {
+            WriteChunk *chunk = calloc(1, sizeof(WriteChunk));
+            chunk->text = batch->errors;
+            chunk->textLength = batch->errorsLength;
+            ringPush(&writer.in, chunk);
+        }
+    }
+
+    // The remaining parsers each still owe their end marker
+    for (int i = 1; i < parserCount; i++) {
+        while (ringPop(&parsers[(batchCount + i) % parserCount].out) != NULL) {
+        }
+    }
+
+    mergeRunsToWriter(batches, batchCount, &writer.in);
+    ringPush(&writer.in, NULL);
+
+    pthread_join(readerThread, NULL);
+    for (int i = 0; i < parserCount; i++) {
+        pthread_join(parserThreads[i], NULL);
+        free(parsers[i].in.items);
+        free(parsers[i].out.items);
+    }
+    pthread_join(writerThread, NULL);
+    checkMemory(rosterRecordWriterFinish(&writer.writer));
+    free(writer.in.items);
+
+    for (int i = 0; i < batchCount; i++) {
+        free(batches[i]->errors);
+        rosterLargeFree(largeBuffers, batches[i]->records);
+        free(batches[i]);
+    }
+    free(batches);
+    free(parserThreads);
+    free(parsers);
+}
+#endif
+
+// Group-by aggregation over (birth year[, month], status) in a single streaming pass
+#define TOEFL_BUCKET_WIDTH 10
+#define TOEFL_BUCKETS 13        // <10, 10-19, ..., 110-119, >=120
+
+typedef struct {
+    int count;
+    double gpaSum;
+    float gpaMin, gpaMax;
+    int gpaHistogram[GPA_BUCKETS];
+    int toeflHistogram[TOEFL_BUCKETS];
+} AggregateGroup;
+
+double groupPercentile(const AggregateGroup *group, int percent) {
+    return histogramPercentile(group->gpaHistogram, group->count, percent);
+}
+
+void writeAggregateGroup(FILE *output, const AggregateGroup *group, int year, int month, char status) {
+    if (month > 0) {
+        fprintf(output, "%d %s %c", year, rosterMonthAbbreviation(month), status);
+    } else {
+        fprintf(output, "%d %c", year, status);
+    }
+    fprintf(output, " count=%d mean=%.3f min=%.3f max=%.3f p25=%.3f p50=%.3f p75=%.3f p90=%.3f\n",
+            group->count, group->gpaSum / group->count, group->gpaMin, group->gpaMax,
+            groupPercentile(group, 25), groupPercentile(group, 50),
+            groupPercentile(group, 75), groupPercentile(group, 90));
+
+    if (status == 'I') {
+        fprintf(output, "  toefl");
+        for (int i = 0; i < TOEFL_BUCKETS; i++) {
+            if (group->toeflHistogram[i] == 0) continue;
+            if (i == 0) {
+                fprintf(output, " <%d=%d", TOEFL_BUCKET_WIDTH, group->toeflHistogram[i]);
+            } else if (i == TOEFL_BUCKETS - 1) {
+                fprintf(output, " >=%d=%d", i * TOEFL_BUCKET_WIDTH, group->toeflHistogram[i]);
+            } else {
+                fprintf(output, " %d-%d=%d", i * TOEFL_BUCKET_WIDTH, i * TOEFL_BUCKET_WIDTH + TOEFL_BUCKET_WIDTH - 1,
+                        group->toeflHistogram[i]);
+            }
+        }
+        fprintf(output, "\n");
+    }
+}
+
+// Stream the input once and write per-group GPA statistics (and TOEFL histograms for 'I');
+// no records are kept and nothing is sorted
+void processAggregate(FILE *input, FILE *output, const Options *options) {
+    int option = options->option;
+    int byMonth = options->aggregate == 2;
+    int months = byMonth ? 12 : 1;
+    int groupCount = AGG_YEARS * months * 2;
+    AggregateGroup *groups = calloc(groupCount, sizeof(AggregateGroup));
+    if (groups == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+
+    LineReader reader;
+    Student student;
+    char *line;
+    size_t length;
+    int result;
+    lineReaderInit(&reader, input, options->maxLineLength);
+    while ((result = lineReaderNext(&reader, &line, &length)) != 0) {
+        if (result < 0) {
+            reportOversizedLine(stderr, options->maxLineLength);
+            continue;
+        }
+        if (!parseStudentLine(line, stderr, &student)) {
+            continue;
+        }
+        if ((student.status == 'D' && option == 2) || (student.status == 'I' && option == 1)) {
+            continue;
+        }
+
+        int slot = (student.year - AGG_FIRST_YEAR) * months + (byMonth ? student.month - 1 : 0);
+        AggregateGroup *group = &groups[slot * 2 + (student.status == 'I')];
+        if (group->count == 0 || student.gpa < group->gpaMin) group->gpaMin = student.gpa;
+        if (group->count == 0 || student.gpa > group->gpaMax) group->gpaMax = student.gpa;
+        group->count++;
+        group->gpaSum += student.gpa;
+        group->gpaHistogram[rosterGpaBucket(student.gpa)]++;
+        if (student.status == 'I') {
+            int bucket = student.toefl / TOEFL_BUCKET_WIDTH;
+            if (student.toefl < 0) bucket = 0;
+            if (bucket >= TOEFL_BUCKETS) bucket = TOEFL_BUCKETS - 1;
+            group->toeflHistogram[bucket]++;
+        }
+    }
+
+    // Same layout as option 3: every domestic group, then every international group
+    for (int status = 0; status < 2; status++) {
+        for (int slot = 0; slot < AGG_YEARS * months; slot++) {
+            const AggregateGroup *group = &groups[slot * 2 + status];
+            if (group->count > 0) {
+                writeAggregateGroup(output, group, AGG_FIRST_YEAR + slot / months,
+                                    byMonth ? slot % months + 1 : 0, status ? 'I' : 'D');
+            }
+        }
+    }
+
+    lineReaderFree(&reader);
+    free(groups);
+}
+
+// --sample: one streaming pass keeping a uniform random sample of the option's valid records in O(N)
+// memory (reservoir sampling, Algorithm R). The generator is splitmix64, so a seed always picks the
+// same sample of the same input.
+#define SAMPLE_MAX_SIZE (1 << 28)
+
+typedef struct {
+    long long sequence;  // position among the sampled-from records, to write the sample in input order
+    Student student;
+} SampleEntry;
+
+static inline int compareSampleEntries(void *context, const SampleEntry *a, const SampleEntry *b) {
+    (void)context;
+    return (a->sequence > b->sequence) - (a->sequence < b->sequence);
+}
+
+DEFINE_TIM_SORT(sortSampleEntries, SampleEntry, compareSampleEntries)
+
+unsigned long long splitMix64(unsigned long long *state) {
+    unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void processSample(FILE *input, FILE *output, const Options *options) {
+    int capacity = options->sampleSize;
+    SampleEntry *sample = rosterLargeAlloc(largeBuffers, (size_t)capacity * sizeof(SampleEntry));
+    if (sample == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    unsigned long long random = options->sampleSeed;
+
+    LineReader reader;
+    Student student;
+    char *line;
+    size_t length;
+    int result, kept = 0;
+    long long seen = 0;
+    lineReaderInit(&reader, input, options->maxLineLength);
+    while ((result = lineReaderNext(&reader, &line, &length)) != 0) {
+        if (result < 0) {
+            reportOversizedLine(stderr, options->maxLineLength);
+            continue;
+        }
+        if (!parseStudentLine(line, stderr, &student) || !rosterOptionIncludes(options->option, &student)) {
+            continue;
+        }
+        // Record seen (counting from 0) replaces a random slot with probability capacity / (seen + 1)
+        if (kept < capacity) {
+            sample[kept].sequence = seen;
+            sample[kept++].student = student;
+        } else {
+            unsigned long long slot = splitMix64(&random) % (unsigned long long)(seen + 1);
+            if (slot < (unsigned long long)capacity) {
+                sample[slot].sequence = seen;
+                sample[slot].student = student;
+            }
+        }
+        seen++;
+    }
+    lineReaderFree(&reader);
+
+    checkMemory(sortSampleEntries(sample, kept, NULL, largeBuffers));
+    Student *students = rosterLargeAlloc(largeBuffers, ((size_t)kept + 1) * sizeof(Student));
+    if (students == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < kept; i++) {
+        students[i] = sample[i].student;
+    }
+    rosterLargeFree(largeBuffers, sample);
+    if (options->sortPlan.keyCount > 0) {
+        checkMemory(rosterSortStudentsByPlan(students, kept, &options->sortPlan, largeBuffers));
+    } else if (options->sampleSorted) {
+        checkMemory(rosterSortStudents(students, kept, NULL, largeBuffers));
+    }
+
+    RecordWriter writer;
+    rosterRecordWriterInit(&writer, output, options->format);
+    for (int i = 0; i < kept; i++) {
+        rosterRecordWriterAdd(&writer, &students[i]);
+    }
+    checkMemory(rosterRecordWriterFinish(&writer));
+    rosterLargeFree(largeBuffers, students);
+}
+
+#ifndef _WIN32
+// Resident server state: the roster is loaded, sorted and indexed once and kept hot between requests
+typedef struct {
+    float gpa;
+    int entry;  // record index, as in the name index
+} GpaIndexEntry;
+
+typedef struct {
+    Roster roster;
+    GpaIndexEntry *byGpa;  // every student, highest GPA first, ties in sorted order
+    struct stat loadedStat;
+} ServeState;
+
+#define SERVE_MAX_CLIENTS 64
+#define SERVE_KEPT_BUFFER_BYTES (1024 * 1024)
+
+static volatile sig_atomic_t serveStopRequested = 0;
+
+void serveHandleStop(int signal) {
+    (void)signal;
+    serveStopRequested = 1;
+}
+
+static inline int compareGpaIndexEntries(void *context, const GpaIndexEntry *a, const GpaIndexEntry *b) {
+    (void)context;
+    if (a->gpa != b->gpa) return (a->gpa > b->gpa) ? -1 : 1;
+    return 0;
+}
+
+DEFINE_TIM_SORT(sortGpaIndex, GpaIndexEntry, compareGpaIndexEntries)
+
+int sameFileVersion(const struct stat *a, const struct stat *b) {
+    return a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+// Load, sort and index the input file into state; the previous roster is kept if the file can't be read
+int serveLoad(const char *inputPath, const Options *options, ServeState *state) {
+    struct stat fileStat;
+    FILE *input = fopen(inputPath, "r");
+    if (input == NULL || fstat(fileno(input), &fileStat) != 0) {
+        fprintf(stderr, "Error: Could not open input file\n");
+        if (input != NULL) fclose(input);
+        return 0;
+    }
+
+    Roster roster;
+    checkMemory(rosterInit(&roster, largeBuffers));
+    checkMemory(rosterEnableDedup(&roster, options->dedup));
+    loadRoster(input, stderr, &roster, options->maxLineLength);
+    fclose(input);
+
+    checkMemory(rosterSortStudents(roster.students, roster.count, NULL, largeBuffers));
+    checkMemory(rosterBuildIndex(&roster));
+
+    GpaIndexEntry *byGpa = malloc((roster.count + 1) * sizeof(GpaIndexEntry));
+    if (byGpa == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < roster.count; i++) {
+        byGpa[i].gpa = roster.students[i].gpa;
+        byGpa[i].entry = i;
+    }
+    checkMemory(sortGpaIndex(byGpa, roster.count, NULL, largeBuffers));
+
+    if (state->roster.students != NULL) {
+        rosterFree(&state->roster);
+        free(state->byGpa);
+    }
+    state->roster = roster;
+    state->byGpa = byGpa;
+    state->loadedStat = fileStat;
+    return 1;
+}
+
+// Reload the roster if the input file was replaced or modified since it was loaded
+void serveRefresh(const char *inputPath, const Options *options, ServeState *state) {
+    struct stat fileStat;
+    if (stat(inputPath, &fileStat) == 0 && !sameFileVersion(&fileStat, &state->loadedStat)) {
+        serveLoad(inputPath, options, state);
+    }
+}
+
+void serveReply(RecordWriter *responses, const char *text) {
+    rosterAppendBytes(&responses->buffer, text, strlen(text));
+}
+
+// Answer one request line into responses; every response ends with an empty line
+void serveRequest(const ServeState *state, const char *request, RecordWriter *responses) {
+    const Roster *roster = &state->roster;
+    char command[16], first[50], second[50];
+    int option = 3;
+
+    if (sscanf(request, "%15s", command) != 1) {
+        return;
+    }
+
+    if (strcmp(command, "dump") == 0 && sscanf(request, "%*s %d", &option) == 1 && option >= 1 && option <= 3) {
+        rosterWrite(responses, roster, option);
+    } else if (strcmp(command, "lookup") == 0 && sscanf(request, "%*s %49s %49s %d", first, second, &option) >= 2) {
+        if (option < 1 || option > 3) {
+            serveReply(responses, "Error: Option must be 1, 2 or 3\n");
+        } else {
+            checkMemory(rosterQueryByName(roster, responses, option, first, second));
+        }
+    } else if (strcmp(command, "range") == 0 && sscanf(request, "%*s %49s %49s %d", first, second, &option) >= 2 &&
+               rosterParseDateKey(first) != -1 && rosterParseDateKey(second) != -1) {
+        if (option < 1 || option > 3) {
+            serveReply(responses, "Error: Option must be 1, 2 or 3\n");
+        } else {
+            checkMemory(rosterQueryByDateRange(roster, responses, option, rosterParseDateKey(first),
+                                               rosterParseDateKey(second)));
+        }
+    } else if (strcmp(command, "top") == 0) {
+        int k = 0;
+        if (sscanf(request, "%*s %d %d", &k, &option) < 1 || k < 0) {
+            serveReply(responses, "Error: Expected top K [option]\n");
+        } else if (option < 1 || option > 3) {
+            serveReply(responses, "Error: Option must be 1, 2 or 3\n");
+        } else {
+            for (int i = 0; i < roster->count && k > 0; i++) {
+                const Student *student = &roster->students[state->byGpa[i].entry];
+                if (rosterOptionIncludes(option, student)) {
+                    rosterRecordWriterAdd(responses, student);
+                    k--;
+                }
+            }
+        }
+    } else if (strcmp(command, "filter") == 0) {
+        float minGpa, maxGpa;
+        if (sscanf(request, "%*s %f %f %d", &minGpa, &maxGpa, &option) < 2) {
+            serveReply(responses, "Error: Expected filter MIN_GPA MAX_GPA [option]\n");
+        } else if (option < 1 || option > 3) {
+            serveReply(responses, "Error: Option must be 1, 2 or 3\n");
+        } else {
+            for (int i = 0; i < roster->count; i++) {
+                const Student *student = &roster->students[i];
+                if (rosterOptionIncludes(option, student) && student->gpa >= minGpa && student->gpa <= maxGpa) {
+                    rosterRecordWriterAdd(responses, student);
+                }
+            }
+        }
+    } else {
+        serveReply(responses, "Error: Unknown request\n");
+    }
+
+    serveReply(responses, "\n");
+    checkMemory(rosterRecordWriterFlush(responses));
+}
+
+// A connected client. Its socket is non-blocking: answers are queued in responses, a writer without a
+// file, and sent as the socket accepts them, so a client that stops reading only holds up itself.
+typedef struct {
+    int fd;
+    RecordWriter responses;
+    size_t sent;                    // bytes of responses.buffer already sent
+    char request[MAX_LINE_LENGTH];  // the request line received so far
+    size_t length;
+    int finished;                   // the client closed its side; its last requests are still answered
+} ServeClient;
+
+int serveClientOpen(ServeClient *client, int connection) {
+    int flags = fcntl(connection, F_GETFL);
+    if (flags == -1 || fcntl(connection, F_SETFL, flags | O_NONBLOCK) == -1) {
+        return 0;
+    }
+    memset(client, 0, sizeof(*client));
+    client->fd = connection;
+    rosterRecordWriterInit(&client->responses, NULL, FORMAT_TEXT);
+    return 1;
+}
+
+void serveClientClose(ServeClient *client) {
+    rosterRecordWriterFinish(&client->responses);
+    close(client->fd);
+}
+
+// Read what the client sent; returns 0 if the connection failed
+int serveClientRead(ServeClient *client) {
+    size_t limit = sizeof(client->request) - 1;
+    if (client->length == limit) {
+        return 1;
+    }
+    ssize_t got = read(client->fd, client->request + client->length, limit - client->length);
+    if (got < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    if (got == 0) {
+        client->finished = 1;
+    }
+    client->length += (size_t)got;
+    return 1;
+}
+
+// Send as much of the queued answer as the socket takes; returns 0 if the connection failed
+int serveClientSend(ServeClient *client) {
+    OutputBuffer *pending = &client->responses.buffer;
+    while (client->sent < pending->length) {
+        ssize_t written = write(client->fd, pending->data + client->sent, pending->length - client->sent);
+        if (written < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        client->sent += (size_t)written;
+    }
+    pending->length = 0;
+    client->sent = 0;
+    // Don't keep a whole dump around per idle client
+    if (pending->capacity > SERVE_KEPT_BUFFER_BYTES) {
+        free(pending->data);
+        pending->data = NULL;
+        pending->capacity = 0;
+    }
+    return 1;
+}
+
+// Answer the complete request lines received so far. The next request is only answered once the previous
+// answer has been sent, so each client holds at most one queued answer. Returns 0 once the client is done.
+int serveClientAnswer(const ServeState *state, ServeClient *client) {
+    size_t limit = sizeof(client->request) - 1;
+    for (;;) {
+        if (!serveClientSend(client)) {
+            return 0;
+        }
+        if (client->responses.buffer.length > 0) {
+            return 1;
+        }
+
+        char *newline = memchr(client->request, '\n', client->length);
+        size_t lineLength, consumed;
+        if (newline != NULL) {
+            lineLength = (size_t)(newline - client->request);
+            consumed = lineLength + 1;
+        } else if (client->length > 0 && (client->length == limit || client->finished)) {
+            // Like fgets, an over-long request is taken in pieces; the last one may lack its newline
+            lineLength = consumed = client->length;
+        } else {
+            return !client->finished;
+        }
+
+        client->request[lineLength] = '\0';
+        client->request[strcspn(client->request, "\r")] = '\0';
+        serveRequest(state, client->request, &client->responses);
+
+        memmove(client->request, client->request + consumed, client->length - consumed);
+        client->length -= consumed;
+    }
+}
+
+#if defined(__linux__)
+// Drain the inotify events; returns 1 if the watch on the input went away or no longer follows its path
+int serveDrainEvents(int notify) {
+    char events[4096];
+    int gone = 0;
+    ssize_t got;
+    while ((got = read(notify, events, sizeof(events))) > 0) {
+        for (ssize_t next = 0; next + (ssize_t)sizeof(struct inotify_event) <= got;) {
+            struct inotify_event event;
+            memcpy(&event, events + next, sizeof(event));
+            if (event.mask & (IN_IGNORED | IN_MOVE_SELF | IN_DELETE_SELF)) {
+                gone = 1;
+            }
+            next += (ssize_t)(sizeof(event) + event.len);
+        }
+    }
+    return gone;
+}
+#endif
+
+// Serve requests over a Unix socket until SIGINT/SIGTERM
+int serveRoster(const char *inputPath, const Options *options) {
+    const char *socketPath = options->servePath;
+    ServeState state;
+    memset(&state, 0, sizeof(state));
+    if (!serveLoad(inputPath, options, &state)) {
+        return 1;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        printf("Error: Socket path too long\n");
+        return 1;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath);
+    if (listener == -1 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        printf("Error: Could not listen on %s\n", socketPath);
+        if (listener != -1) close(listener);
+        return 1;
+    }
+
+    struct sigaction stopAction;
+    memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = serveHandleStop;
+    sigaction(SIGINT, &stopAction, NULL);
+    sigaction(SIGTERM, &stopAction, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // inotify reports changes to the input; without it the input is checked at most once a second
+    int notify = -1, watched = -1;
+    ino_t watchedInode = 0;
+    time_t lastCheck = time(NULL);
+#if defined(__linux__)
+    notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+    // One thread polls the listener and every open connection, so requests from several clients are
+    // answered as their lines arrive and the roster is only ever touched from here
+    ServeClient clients[SERVE_MAX_CLIENTS];
+    struct pollfd pending[SERVE_MAX_CLIENTS + 2];
+    int clientCount = 0;
+    while (!serveStopRequested) {
+        int refresh = 0;
+#if defined(__linux__)
+        if (notify != -1 && watched == -1) {
+            struct stat fileStat;
+            watched = inotify_add_watch(notify, inputPath, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+            if (watched != -1 && stat(inputPath, &fileStat) == 0) {
+                watchedInode = fileStat.st_ino;
+            }
+            // Catch up with changes made before the watch was added
+            refresh = 1;
+        }
+#endif
+
+        pending[0] = (struct pollfd){listener, POLLIN, 0};
+        pending[1] = (struct pollfd){notify, POLLIN, 0};
+        for (int i = 0; i < clientCount; i++) {
+            short events = clients[i].responses.buffer.length > 0 ? POLLOUT : POLLIN;
+            pending[i + 2] = (struct pollfd){clients[i].fd, events, 0};
+        }
+        int ready = poll(pending, (nfds_t)clientCount + 2, 1000);
+
+#if defined(__linux__)
+        if (ready > 0 && (pending[1].revents & POLLIN) && serveDrainEvents(notify)) {
+            inotify_rm_watch(notify, watched);
+            watched = -1;
+        }
+#endif
+        refresh |= ready > 0 && (pending[1].revents & POLLIN);
+        if (watched == -1 && time(NULL) - lastCheck >= 1) {
+            refresh = 1;
+        }
+        if (refresh) {
+            struct stat fileStat;
+            serveRefresh(inputPath, options, &state);
+            lastCheck = time(NULL);
+#if defined(__linux__)
+            // The path now names another file: follow it
+            if (watched != -1 && stat(inputPath, &fileStat) == 0 && fileStat.st_ino != watchedInode) {
+                inotify_rm_watch(notify, watched);
+                watched = -1;
+            }
+#else
+            (void)fileStat;
+            (void)watchedInode;
+#endif
+        }
+        if (ready <= 0) continue;
+
+        // Downwards, so a closed client can be replaced by the last one, which was already handled
+        for (int i = clientCount - 1; i >= 0; i--) {
+            short revents = pending[i + 2].revents;
+            int open = 1;
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                open = serveClientRead(&clients[i]);
+            }
+            if (open && revents != 0) {
+                open = serveClientAnswer(&state, &clients[i]);
+            }
+            if (!open) {
+                serveClientClose(&clients[i]);
+                clients[i] = clients[--clientCount];
+            }
+        }
+
+        if (pending[0].revents & POLLIN) {
+            int connection = accept(listener, NULL, NULL);
+            if (connection != -1 && (clientCount == SERVE_MAX_CLIENTS || !serveClientOpen(&clients[clientCount], connection))) {
+                close(connection);
+            } else if (connection != -1) {
+                clientCount++;
+            }
+        }
+    }
+
+    for (int i = 0; i < clientCount; i++) {
+        serveClientClose(&clients[i]);
+    }
+    if (notify != -1) {
+        close(notify);
+    }
+    close(listener);
+    unlink(socketPath);
+    rosterFree(&state.roster);
+    free(state.byGpa);
+    return 0;
+}
+#endif
+
+#ifndef _WIN32
+// --watch: the input is tailed from the last consumed byte. Only the new complete lines are parsed;
+// their records are sorted and merged into the sorted roster kept in memory, and the output is
+// rewritten to a temporary file that replaces it, so readers always see a complete output.
+#define WATCH_POLL_MILLISECONDS 1000
+
+typedef struct {
+    FILE *input;
+    struct stat inputStat;  // the file being tailed, to notice when it is replaced or truncated
+    long long consumed;     // input bytes read so far, including the pending partial line
+    OutputBuffer pending;   // the last line read, until its newline arrives
+    int pendingOversized;   // the pending line is already longer than the limit and is being skipped
+    Roster sorted;          // every accepted student, in output order
+    Roster batch;           // the students of the lines read in one update
+    OutputBuffer rejected;  // text format: every rejected-line message so far, in input order
+} WatchState;
+
+static volatile sig_atomic_t watchStopRequested = 0;
+
+void watchHandleStop(int signal) {
+    (void)signal;
+    watchStopRequested = 1;
+}
+
+// Rejected lines: kept for the next rewrite in the text format, reported on stderr otherwise
+void watchReject(WatchState *state, const Options *options, const char *message) {
+    if (options->format == FORMAT_TEXT) {
+        rosterAppendBytes(&state->rejected, message, strlen(message));
+    } else {
+        fputs(message, stderr);
+    }
+}
+
+void watchTakeLine(WatchState *state, const Options *options, char *line, size_t length) {
+    char message[128], detail[256];
+    Student student;
+    if (state->pendingOversized || length > options->maxLineLength) {
+        snprintf(message, sizeof(message), "Error: Line too long - exceeds %zu bytes\n", options->maxLineLength);
+        watchReject(state, options, message);
+        state->pendingOversized = 0;
+        return;
+    }
+    line[length] = '\0';
+    if (rosterParseStudentRecord(line, &student, message, sizeof(message), detail, sizeof(detail))) {
+        checkMemory(rosterAdd(&state->batch, &student));
+    } else {
+        fputs(detail, stderr);
+        watchReject(state, options, message);
+    }
+}
+
+// Merge the sorted batch into the sorted roster in place, from the back
+void watchMergeBatch(WatchState *state) {
+    Roster *sorted = &state->sorted;
+    const Roster *batch = &state->batch;
+    int total = sorted->count + batch->count;
+    if (total > sorted->capacity) {
+        int capacity = sorted->capacity;
+        while (capacity < total) capacity *= 2;
+        size_t oldBytes = (size_t)sorted->capacity * sizeof(Student);
+        Student *grown = rosterLargeRealloc(sorted->allocator, sorted->students, oldBytes,
+                                            (size_t)capacity * sizeof(Student));
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        sorted->students = grown;
+        sorted->capacity = capacity;
+    }
+    int old = sorted->count - 1, added = batch->count - 1;
+    for (int out = total - 1; added >= 0; out--) {
+        if (old >= 0 && compareStudentRecords(NULL, &sorted->students[old], &batch->students[added]) > 0) {
+            sorted->students[out] = sorted->students[old--];
+        } else {
+            sorted->students[out] = batch->students[added--];
+        }
+    }
+    sorted->count = total;
+}
+
+// Read what was appended since the last update. Returns the number of lines completed.
+int watchReadAppended(WatchState *state, const Options *options) {
+    char *block = malloc(LINE_BLOCK_SIZE);
+    if (block == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    int lines = 0;
+    size_t got;
+    clearerr(state->input);
+    state->batch.count = 0;
+    while ((got = fread(block, 1, LINE_BLOCK_SIZE, state->input)) > 0) {
+        state->consumed += (long long)got;
+        const char *data = block, *end = block + got;
+        const char *newline;
+        while ((newline = memchr(data, '\n', (size_t)(end - data))) != NULL) {
+            if (!state->pendingOversized) {
+                rosterAppendBytes(&state->pending, data, (size_t)(newline - data));
+            }
+            rosterAppendChar(&state->pending, '\0');
+            checkMemory(state->pending.failed || state->rejected.failed ? -1 : 0);
+            watchTakeLine(state, options, state->pending.data, state->pending.length - 1);
+            state->pending.length = 0;
+            data = newline + 1;
+            lines++;
+        }
+        if (!state->pendingOversized) {
+            rosterAppendBytes(&state->pending, data, (size_t)(end - data));
+            // Past the limit: drop what was read of this line instead of keeping all of it
+            if (state->pending.length > options->maxLineLength) {
+                state->pendingOversized = 1;
+                state->pending.length = 0;
+            }
+        }
+    }
+    free(block);
+
+    rosterSelect(&state->batch, options->option);
+    checkMemory(rosterSortStudents(state->batch.students, state->batch.count, NULL, largeBuffers));
+    watchMergeBatch(state);
+    return lines;
+}
+
+// Write the whole output next to outputPath and move it into place
+int watchWriteOutput(const char *outputPath, const WatchState *state, const Options *options) {
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", outputPath);
+    FILE *output = fopen(temporary, "w");
+    if (output == NULL) {
+        return 0;
+    }
+    fwrite(state->rejected.data, 1, state->rejected.length, output);
+    RecordWriter writer;
+    rosterRecordWriterInit(&writer, output, options->format);
+    for (int i = 0; i < state->sorted.count; i++) {
+        rosterRecordWriterAdd(&writer, &state->sorted.students[i]);
+    }
+    checkMemory(rosterRecordWriterFinish(&writer));
+    int written = !ferror(output);
+    written &= fclose(output) == 0;
+    return written && rename(temporary, outputPath) == 0;
+}
+
+// (Re)open the input and start over from its first byte
+int watchOpen(const char *inputPath, WatchState *state) {
+    if (state->input != NULL) {
+        fclose(state->input);
+    }
+    state->input = fopen(inputPath, "r");
+    if (state->input == NULL || fstat(fileno(state->input), &state->inputStat) != 0) {
+        return 0;
+    }
+    state->consumed = 0;
+    state->pending.length = 0;
+    state->pendingOversized = 0;
+    state->sorted.count = 0;
+    state->rejected.length = 0;
+    return 1;
+}
+
+// Keep outputPath equal to the plain sorted output of the input until SIGINT/SIGTERM. A final line
+// without a newline is taken once it is finished.
+int watchRoster(const char *inputPath, const char *outputPath, const Options *options) {
+    WatchState state;
+    memset(&state, 0, sizeof(state));
+    checkMemory(rosterInit(&state.sorted, largeBuffers));
+    checkMemory(rosterInit(&state.batch, largeBuffers));
+    if (!watchOpen(inputPath, &state)) {
+        printf("Error: Could not open input file\n");
+        rosterFree(&state.sorted);
+        rosterFree(&state.batch);
+        return 1;
+    }
+
+    struct sigaction stopAction;
+    memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = watchHandleStop;
+    sigaction(SIGINT, &stopAction, NULL);
+    sigaction(SIGTERM, &stopAction, NULL);
+
+    // inotify wakes the loop as soon as the input changes; without it the input is checked every poll
+    int notify = -1, watched = -1;
+#if defined(__linux__)
+    notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+    int status = 0, changed = 1, reopened = 1;
+    while (!watchStopRequested) {
+        // Appending only part of a line leaves the output as it is
+        if (changed && (watchReadAppended(&state, options) > 0 || reopened)) {
+            reopened = 0;
+            if (!watchWriteOutput(outputPath, &state, options)) {
+                printf("Error: Could not write output file\n");
+                status = 1;
+                break;
+            }
+        }
+
+#if defined(__linux__)
+        if (notify != -1 && watched == -1) {
+            watched = inotify_add_watch(notify, inputPath, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+        }
+#endif
+        struct pollfd pending = {notify, POLLIN, 0};
+        int ready = poll(&pending, notify != -1 ? 1 : 0, WATCH_POLL_MILLISECONDS);
+        if (ready > 0) {
+            char events[4096];
+            while (read(notify, events, sizeof(events)) > 0) {
+            }
+        }
+
+        // Appended bytes are read from the consumed offset; a replaced or truncated input is read again
+        struct stat fileStat;
+        changed = 0;
+        if (stat(inputPath, &fileStat) != 0) {
+            continue;
+        }
+        if (fileStat.st_ino != state.inputStat.st_ino || fileStat.st_dev != state.inputStat.st_dev ||
+            (long long)fileStat.st_size < state.consumed) {
+#if defined(__linux__)
+            if (watched != -1) {
+                inotify_rm_watch(notify, watched);
+                watched = -1;
+            }
+#endif
+            changed = reopened = watchOpen(inputPath, &state);
+        } else {
+            changed = (long long)fileStat.st_size > state.consumed;
+        }
+    }
+
+    if (notify != -1) {
+        close(notify);
+    }
+    if (state.input != NULL) {
+        fclose(state.input);
+    }
+    free(state.pending.data);
+    free(state.rejected.data);
+    rosterFree(&state.sorted);
+    rosterFree(&state.batch);
+    return status;
+}
+#endif
+
+// Optional io_uring backend for the input and output files. The streams are exposed as ordinary
+// FILE pointers (fopencookie), so every reader and writer above works with them unchanged.
+#define IO_STDIO 0
+#define IO_URING 1
+
+#ifdef HAVE_IO_URING
+#define URING_BUFFERS 4
+#define URING_BUFFER_SIZE (1 << 20)
+#define URING_IDLE 0
+#define URING_IN_FLIGHT 1
+#define URING_DONE 2
+
+typedef struct {
+    int ringFd;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+} Uring;
+
+typedef struct {
+    Uring ring;
+    int fd;
+    int writing;
+    int fixedBuffers;                    // buffers registered with the ring (READ_FIXED/WRITE_FIXED)
+    int failed;
+    char *buffers[URING_BUFFERS];
+    int state[URING_BUFFERS];
+    off_t offset[URING_BUFFERS];         // file offset of each buffer's first byte
+    ssize_t length[URING_BUFFERS];       // bytes read into / to be written from the buffer
+    ssize_t done[URING_BUFFERS];         // bytes of a write already completed
+    off_t nextOffset;                    // next read to submit / next write position
+    int current;                         // buffer being consumed (read) or filled (write)
+    size_t position;                     // read/fill position inside the current buffer
+} UringStream;
+
+int uringInit(Uring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->ringFd < 0) {
+        return 0;
+    }
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingSize > ring->sqRingSize) ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->ringFd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) {
+        close(ring->ringFd);
+        return 0;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    } else {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->ringFd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED) {
+            munmap(ring->sqRing, ring->sqRingSize);
+            close(ring->ringFd);
+            return 0;
+        }
+    }
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->ringFd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+        munmap(ring->sqRing, ring->sqRingSize);
+        close(ring->ringFd);
+        return 0;
+    }
+
+    char *sq = ring->sqRing, *cq = ring->cqRing;
+    ring->sqHead = (unsigned *)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 1;
+}
+
+void uringDestroy(Uring *ring) {
+    munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+    munmap(ring->sqRing, ring->sqRingSize);
+    close(ring->ringFd);
+}
+
+// Queue one read or write of a stream buffer and hand it to the kernel
+int uringSubmit(UringStream *stream, int buffer, char *address, size_t length, off_t offset) {
+    Uring *ring = &stream->ring;
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    if (stream->fixedBuffers) {
+        sqe->opcode = stream->writing ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = buffer;
+    } else {
+        sqe->opcode = stream->writing ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    sqe->fd = stream->fd;
+    sqe->addr = (unsigned long)address;
+    sqe->len = (unsigned)length;
+    sqe->off = offset;
+    sqe->user_data = buffer;
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    stream->state[buffer] = URING_IN_FLIGHT;
+    return syscall(__NR_io_uring_enter, ring->ringFd, 1, 0, 0, NULL, 0) == 1;
+}
+
+// Wait for one completion and record it against its buffer
+void uringReap(UringStream *stream) {
+    Uring *ring = &stream->ring;
+    unsigned head = *ring->cqHead;
+    while (__atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE) == head) {
+        syscall(__NR_io_uring_enter, ring->ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    }
+    struct io_uring_cqe cqe = ring->cqes[head & *ring->cqMask];
+    __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+
+    int buffer = (int)cqe.user_data;
+    if (!stream->writing) {
+        stream->length[buffer] = cqe.res;
+        stream->state[buffer] = URING_DONE;
+        return;
+    }
+    if (cqe.res <= 0) {
+        stream->failed = 1;
+        stream->state[buffer] = URING_IDLE;
+        return;
+    }
+    // Short write: send the rest of the buffer
+    stream->done[buffer] += cqe.res;
+    if (stream->done[buffer] < stream->length[buffer]) {
+        uringSubmit(stream, buffer, stream->buffers[buffer] + stream->done[buffer],
+                    stream->length[buffer] - stream->done[buffer], stream->offset[buffer] + stream->done[buffer]);
+    } else {
+        stream->state[buffer] = URING_IDLE;
+    }
+}
+
+void uringDrain(UringStream *stream) {
+    for (int i = 0; i < URING_BUFFERS; i++) {
+        while (stream->state[i] == URING_IN_FLIGHT) {
+            uringReap(stream);
+        }
+    }
+}
+
+// Start reads for every buffer from offset on, in consumption order beginning with first
+void uringPrefetch(UringStream *stream, int first, off_t offset) {
+    for (int i = 0; i < URING_BUFFERS; i++) {
+        int buffer = (first + i) % URING_BUFFERS;
+        stream->offset[buffer] = offset;
+        uringSubmit(stream, buffer, stream->buffers[buffer], URING_BUFFER_SIZE, offset);
+        offset += URING_BUFFER_SIZE;
+    }
+    stream->nextOffset = offset;
+    stream->current = first;
+    stream->position = 0;
+}
+
+ssize_t uringRead(void *cookie, char *destination, size_t size) {
+    UringStream *stream = cookie;
+    size_t copied = 0;
+
+    while (copied < size) {
+        int buffer = stream->current;
+        while (stream->state[buffer] == URING_IN_FLIGHT) {
+            uringReap(stream);
+        }
+        ssize_t length = stream->length[buffer];
+        if (length < 0) {
+            errno = (int)-length;
+            return copied > 0 ? (ssize_t)copied : -1;
+        }
+        if (stream->position < (size_t)length) {
+            size_t chunk = (size_t)length - stream->position;
+            if (chunk > size - copied) chunk = size - copied;
+            memcpy(destination + copied, stream->buffers[buffer] + stream->position, chunk);
+            stream->position += chunk;
+            copied += chunk;
+            continue;
+        }
+        if (length == 0) {
+            break;  // end of file
+        }
+
+        // Buffer used up: reuse it for the next read ahead, or re-align after a short read
+        int next = (buffer + 1) % URING_BUFFERS;
+        if (length == URING_BUFFER_SIZE) {
+            stream->offset[buffer] = stream->nextOffset;
+            uringSubmit(stream, buffer, stream->buffers[buffer], URING_BUFFER_SIZE, stream->nextOffset);
+            stream->nextOffset += URING_BUFFER_SIZE;
+            stream->current = next;
+            stream->position = 0;
+        } else {
+            uringDrain(stream);
+            uringPrefetch(stream, next, stream->offset[buffer] + length);
+        }
+    }
+    return (ssize_t)copied;
+}
+
+// Hand the filled buffer to the kernel and move on to the next free one
+void uringFlushCurrent(UringStream *stream) {
+    int buffer = stream->current;
+    if (stream->position == 0) {
+        return;
+    }
+    stream->offset[buffer] = stream->nextOffset;
+    stream->length[buffer] = (ssize_t)stream->position;
+    stream->done[buffer] = 0;
+    if (!uringSubmit(stream, buffer, stream->buffers[buffer], stream->position, stream->nextOffset)) {
+        stream->failed = 1;
+        stream->state[buffer] = URING_IDLE;
+    }
+    stream->nextOffset += (off_t)stream->position;
+
+    stream->current = (buffer + 1) % URING_BUFFERS;
+    stream->position = 0;
+    while (stream->state[stream->current] == URING_IN_FLIGHT) {
+        uringReap(stream);
+    }
+}
+
+ssize_t uringWrite(void *cookie, const char *source, size_t size) {
+    UringStream *stream = cookie;
+    size_t copied = 0;
+
+    while (copied < size) {
+        size_t chunk = URING_BUFFER_SIZE - stream->position;
+        if (chunk > size - copied) chunk = size - copied;
+        memcpy(stream->buffers[stream->current] + stream->position, source + copied, chunk);
+        stream->position += chunk;
+        copied += chunk;
+        if (stream->position == URING_BUFFER_SIZE) {
+            uringFlushCurrent(stream);
+        }
+    }
+    return stream->failed ? -1 : (ssize_t)size;
+}
+
+int uringSeek(void *cookie, off64_t *offset, int whence) {
+    UringStream *stream = cookie;
+    off_t current = stream->writing ? stream->nextOffset + (off_t)stream->position
+                                    : stream->offset[stream->current] + (off_t)stream->position;
+    off_t target;
+
+    if (whence == SEEK_SET) {
+        target = *offset;
+    } else if (whence == SEEK_CUR) {
+        target = current + *offset;
+    } else {
+        struct stat fileStat;
+        if (stream->writing) uringFlushCurrent(stream);
+        uringDrain(stream);
+        if (fstat(stream->fd, &fileStat) != 0) return -1;
+        target = fileStat.st_size + *offset;
+    }
+    if (target < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (stream->writing) {
+        uringFlushCurrent(stream);
+        uringDrain(stream);
+        stream->nextOffset = target;
+    } else if (target != current) {
+        uringDrain(stream);
+        uringPrefetch(stream, stream->current, target);
+    }
+    *offset = target;
+    return 0;
+}
+
+int uringClose(void *cookie) {
+    UringStream *stream = cookie;
+    if (stream->writing) {
+        uringFlushCurrent(stream);
+    }
+    uringDrain(stream);
+
+    int failed = stream->failed;
+    uringDestroy(&stream->ring);
+    close(stream->fd);
+    for (int i = 0; i < URING_BUFFERS; i++) {
+        free(stream->buffers[i]);
+    }
+    free(stream);
+    return failed ? EOF : 0;
+}
+
+// Open path on an io_uring stream; NULL if io_uring can't be used for it
+FILE *uringOpen(const char *path, int writing) {
+    int fd = writing ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666) : open(path, O_RDONLY);
+    struct stat fileStat;
+    if (fd < 0) {
+        return NULL;
+    }
+    // Reads are issued ahead at fixed offsets, which needs a regular file
+    if (fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+
+    UringStream *stream = calloc(1, sizeof(UringStream));
+    if (stream == NULL || !uringInit(&stream->ring, URING_BUFFERS * 2)) {
+        free(stream);
+        close(fd);
+        return NULL;
+    }
+    stream->fd = fd;
+    stream->writing = writing;
+
+    struct iovec registered[URING_BUFFERS];
+    for (int i = 0; i < URING_BUFFERS; i++) {
+        stream->buffers[i] = aligned_alloc(4096, URING_BUFFER_SIZE);
+        if (stream->buffers[i] == NULL) {
+            stream->failed = 1;
+            uringClose(stream);
+            return NULL;
+        }
+        registered[i].iov_base = stream->buffers[i];
+        registered[i].iov_len = URING_BUFFER_SIZE;
+    }
+    // Registration pins the buffers; without enough RLIMIT_MEMLOCK plain READ/WRITE is used instead
+    stream->fixedBuffers = syscall(__NR_io_uring_register, stream->ring.ringFd, IORING_REGISTER_BUFFERS,
+                                   registered, URING_BUFFERS) == 0;
+
+    if (!writing) {
+        uringPrefetch(stream, 0, 0);
+    }
+
+    cookie_io_functions_t functions = {uringRead, uringWrite, uringSeek, uringClose};
+    FILE *file = fopencookie(stream, writing ? "w" : "r", functions);
+    if (file == NULL) {
+        uringClose(stream);
+    }
+    return file;
+}
+#endif
+
+#ifdef HAVE_GZIP
+// Compressed files: gzip input is recognized by its magic bytes and inflated on its own thread, which
+// hands 1 MiB blocks to the reading stream, so decompression overlaps parsing. Output files named
+// *.gz are deflated as they are written (level 1). Both are FILE pointers, like the io_uring streams.
+#define GZIP_BLOCK_SIZE (1 << 20)
+#define GZIP_CHUNK_SIZE (256 * 1024)
+#define GZIP_RING_SIZE 4
+
+typedef struct {
+    FILE *source;            // the compressed stream, closed with the reader
+    unsigned char magic[2];  // already read from source to recognize it
+    SpscRing blocks;         // inflated InputBlocks, then NULL
+    pthread_t thread;
+    atomic_int stop;         // closed before the end: the thread stops after its current block
+    int failed;              // corrupt or truncated input; set before the final NULL is pushed
+    InputBlock *current;
+    size_t position;         // bytes of current already returned
+    int finished;
+} GzipReader;
+
+typedef struct {
+    FILE *target;
+    z_stream stream;
+    unsigned char *chunk;
+    int failed;
+} GzipWriter;
+
+void *gzipInflateWorker(void *arg) {
+    GzipReader *reader = arg;
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    unsigned char *chunk = malloc(GZIP_CHUNK_SIZE);
+    if (chunk == NULL || inflateInit2(&stream, 15 + 16) != Z_OK) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    stream.next_in = reader->magic;
+    stream.avail_in = sizeof(reader->magic);
+
+    int status = Z_OK, memberEnded = 0;
+    while (status == Z_OK && !atomic_load(&reader->stop)) {
+        InputBlock *block = malloc(sizeof(InputBlock));
+        char *data = malloc(GZIP_BLOCK_SIZE);
+        if (block == NULL || data == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        stream.next_out = (unsigned char *)data;
+        stream.avail_out = GZIP_BLOCK_SIZE;
+        while (stream.avail_out > 0) {
+            if (stream.avail_in == 0) {
+                size_t got = fread(chunk, 1, GZIP_CHUNK_SIZE, reader->source);
+                if (got == 0) {
+                    status = memberEnded ? Z_STREAM_END : Z_DATA_ERROR;
+                    break;
+                }
+                stream.next_in = chunk;
+                stream.avail_in = (unsigned)got;
+            }
+            int result = inflate(&stream, Z_NO_FLUSH);
+            if (result == Z_STREAM_END) {
+                // Concatenated members read as one stream
+                inflateReset(&stream);
+                memberEnded = 1;
+            } else if (result == Z_OK) {
+                memberEnded = 0;
+            } else {
+                status = Z_DATA_ERROR;
+                break;
+            }
+        }
+        block->data = data;
+        block->length = GZIP_BLOCK_SIZE - stream.avail_out;
+        if (block->length > 0) {
+            ringPush(&reader->blocks, block);
+        } else {
+            free(data);
+            free(block);
+        }
+    }
+
+    if (status == Z_DATA_ERROR) {
+        fprintf(stderr, "Error: Corrupt or truncated compressed input\n");
+        reader->failed = 1;
+    }
+    ringPush(&reader->blocks, NULL);
+    inflateEnd(&stream);
+    free(chunk);
+    return NULL;
+}
+
+ssize_t gzipRead(void *cookie, char *destination, size_t size) {
+    GzipReader *reader = cookie;
+    size_t copied = 0;
+    while (copied == 0 && !reader->finished) {
+        if (reader->current == NULL) {
+            reader->current = ringPop(&reader->blocks);
+            reader->position = 0;
+            if (reader->current == NULL) {
+                reader->finished = 1;
+                break;
+            }
+        }
+        InputBlock *block = reader->current;
+        copied = block->length - reader->position < size ? block->length - reader->position : size;
+        memcpy(destination, block->data + reader->position, copied);
+        reader->position += copied;
+        if (reader->position == block->length) {
+            free(block->data);
+            free(block);
+            reader->current = NULL;
+        }
+    }
+    return copied == 0 && reader->failed ? -1 : (ssize_t)copied;
+}
+
+int gzipReaderClose(void *cookie) {
+    GzipReader *reader = cookie;
+    atomic_store(&reader->stop, 1);
+    if (reader->current != NULL) {
+        free(reader->current->data);
+        free(reader->current);
+    }
+    while (!reader->finished) {
+        InputBlock *block = ringPop(&reader->blocks);
+        if (block == NULL) {
+            reader->finished = 1;
+        } else {
+            free(block->data);
+            free(block);
+        }
+    }
+    pthread_join(reader->thread, NULL);
+    int closed = fclose(reader->source);
+    free(reader->blocks.items);
+    free(reader);
+    return closed;
+}
+
+// Deflate what is pending in the stream and write it out; Z_FINISH also ends the gzip member
+void gzipDeflate(GzipWriter *writer, int flush) {
+    int result;
+    do {
+        writer->stream.next_out = writer->chunk;
+        writer->stream.avail_out = GZIP_CHUNK_SIZE;
+        result = deflate(&writer->stream, flush);
+        size_t produced = GZIP_CHUNK_SIZE - writer->stream.avail_out;
+        if (produced > 0 && fwrite(writer->chunk, 1, produced, writer->target) != produced) {
+            writer->failed = 1;
+        }
+    } while (result != Z_STREAM_ERROR && (flush == Z_FINISH ? result != Z_STREAM_END : writer->stream.avail_out == 0));
+}
+
+ssize_t gzipWrite(void *cookie, const char *source, size_t size) {
+    GzipWriter *writer = cookie;
+    size_t done = 0;
+    while (done < size && !writer->failed) {
+        size_t length = size - done < (1u << 30) ? size - done : (1u << 30);
+        writer->stream.next_in = (unsigned char *)source + done;
+        writer->stream.avail_in = (unsigned)length;
+        gzipDeflate(writer, Z_NO_FLUSH);
+        done += length;
+    }
+    return writer->failed ? -1 : (ssize_t)size;
+}
+
+int gzipWriterClose(void *cookie) {
+    GzipWriter *writer = cookie;
+    writer->stream.avail_in = 0;
+    gzipDeflate(writer, Z_FINISH);
+    deflateEnd(&writer->stream);
+    int closed = fclose(writer->target);
+    int failed = writer->failed;
+    free(writer->chunk);
+    free(writer);
+    return failed || closed != 0 ? EOF : 0;
+}
+
+// Put the gzip layer over file when it applies: input starting with the gzip magic bytes, output named *.gz.
+// file is closed and NULL returned on failure.
+FILE *gzipWrap(FILE *file, const char *path, int writing) {
+    cookie_io_functions_t functions;
+    void *cookie;
+    if (writing) {
+        size_t length = strlen(path);
+        if (length < 3 || strcmp(path + length - 3, ".gz") != 0) {
+            return file;
+        }
+        GzipWriter *writer = calloc(1, sizeof(GzipWriter));
+        if (writer == NULL || (writer->chunk = malloc(GZIP_CHUNK_SIZE)) == NULL ||
+            deflateInit2(&writer->stream, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        writer->target = file;
+        cookie_io_functions_t writeFunctions = {NULL, gzipWrite, NULL, gzipWriterClose};
+        functions = writeFunctions;
+        cookie = writer;
+    } else {
+        unsigned char magic[2];
+        size_t got = fread(magic, 1, sizeof(magic), file);
+        if (got != sizeof(magic) || magic[0] != 0x1f || magic[1] != 0x8b) {
+            // Not compressed: start over, or hand the bytes back to a pipe
+            if (fseeko(file, 0, SEEK_SET) != 0) {
+                clearerr(file);
+                while (got > 0) {
+                    ungetc(magic[--got], file);
+                }
+            }
+            return file;
+        }
+        GzipReader *reader = calloc(1, sizeof(GzipReader));
+        if (reader == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        reader->source = file;
+        memcpy(reader->magic, magic, sizeof(magic));
+        ringInit(&reader->blocks, GZIP_RING_SIZE);
+        atomic_init(&reader->stop, 0);
+        pthread_create(&reader->thread, NULL, gzipInflateWorker, reader);
+        cookie_io_functions_t readFunctions = {gzipRead, NULL, NULL, gzipReaderClose};
+        functions = readFunctions;
+        cookie = reader;
+    }
+
+    FILE *wrapped = fopencookie(cookie, writing ? "w" : "r", functions);
+    if (wrapped == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    return wrapped;
+}
+#endif
+
+// Open an input or output file on the requested I/O backend, falling back to stdio. "-" is stdin or
+// stdout, read and written in large blocks.
+FILE *openStream(const char *path, const char *mode, int ioBackend) {
+    FILE *file = NULL;
+    if (strcmp(path, "-") == 0) {
+        file = mode[0] == 'w' ? stdout : stdin;
+        setvbuf(file, NULL, _IOFBF, LINE_BLOCK_SIZE);
+        if (ioBackend == IO_URING) {
+            fprintf(stderr, "Warning: io_uring unavailable for %s, using stdio\n", mode[0] == 'w' ? "stdout" : "stdin");
+        }
+#ifdef HAVE_GZIP
+        file = gzipWrap(file, path, mode[0] == 'w');
+#endif
+        return file;
+    }
+#ifdef HAVE_IO_URING
+    if (ioBackend == IO_URING) {
+        file = uringOpen(path, mode[0] == 'w');
+        if (file == NULL) {
+            fprintf(stderr, "Warning: io_uring unavailable for %s, using stdio\n", path);
+        }
+    }
+#else
+    if (ioBackend == IO_URING) {
+        fprintf(stderr, "Warning: io_uring not supported on this platform, using stdio\n");
+    }
+#endif
+    if (file == NULL) {
+        file = fopen(path, mode);
+    }
+#ifdef HAVE_GZIP
+    if (file != NULL) {
+        file = gzipWrap(file, path, mode[0] == 'w');
+    }
+#endif
+    return file;
+}
+
+// --merge: k-way merge of sorted runs written by --shard (text or binary) into the output a single
+// process would have written. Text runs are streamed. Binary run files are mapped, so their pages are
+// read as the merge reaches them and can be dropped again; compressed or piped ones are read whole.
+typedef struct {
+    const char *path;
+    FILE *file;
+    int binary;
+    LineReader reader;
+    unsigned char *data;                // binary run contents
+    size_t mapped;                      // bytes mapped at data, 0 if data was read into memory
+    unsigned long long recordCount, next;
+    size_t poolOffset, poolSize;
+    Student head;
+    int hasHead;
+    int corrupt;                        // a binary record pointed outside the run; the merge stops
+} MergeRun;
+
+unsigned long long readLittleEndian(const unsigned char *bytes, int count) {
+    unsigned long long value = 0;
+    for (int i = count - 1; i >= 0; i--) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+int mergeRunOpen(MergeRun *run, const char *path, int ioBackend, size_t maxLineLength) {
+    memset(run, 0, sizeof(*run));
+    run->path = path;
+    run->file = openStream(path, "r", ioBackend);
+    if (run->file == NULL) {
+        return 0;
+    }
+
+    char magic[8];
+    size_t got = fread(magic, 1, sizeof(magic), run->file);
+    if (got == sizeof(magic) && memcmp(magic, BINARY_MAGIC, 8) == 0) {
+        size_t capacity = 1 << 20, size = got;
+#if defined(__linux__)
+        struct stat runStat;
+        int fd = fileno(run->file);
+        if (fd >= 0 && fstat(fd, &runStat) == 0 && S_ISREG(runStat.st_mode) && runStat.st_size >= 32) {
+            void *pages = mmap(NULL, (size_t)runStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (pages != MAP_FAILED) {
+                size = run->mapped = (size_t)runStat.st_size;
+                madvise(pages, size, MADV_SEQUENTIAL);
+                run->data = pages;
+            }
+        }
+#endif
+        if (run->mapped == 0) {
+            run->data = malloc(capacity);
+            if (run->data == NULL) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(1);
+            }
+            memcpy(run->data, magic, got);
+            while ((got = fread(run->data + size, 1, capacity - size, run->file)) > 0) {
+                size += got;
+                if (size == capacity) {
+                    capacity *= 2;
+                    run->data = realloc(run->data, capacity);
+                    if (run->data == NULL) {
+                        fprintf(stderr, "Error: Out of memory\n");
+                        exit(1);
+                    }
+                }
+            }
+        }
+        if (size < 32 || readLittleEndian(run->data + 8, 4) != BINARY_RECORD_SIZE) {
+            return 0;
+        }
+        run->binary = 1;
+        run->recordCount = readLittleEndian(run->data + size - 16, 8);
+        run->poolSize = (size_t)readLittleEndian(run->data + size - 8, 8);
+        if (run->recordCount > (size - 32) / BINARY_RECORD_SIZE) {
+            return 0;
+        }
+        run->poolOffset = 16 + (size_t)run->recordCount * BINARY_RECORD_SIZE;
+        return run->poolSize == size - 16 - run->poolOffset;
+    }
+
+    // Text run: read it line by line, starting with the bytes already read, so it can be a pipe
+    lineReaderInit(&run->reader, run->file, maxLineLength);
+    memcpy(run->reader.buffer, magic, got);
+    run->reader.end = got;
+    return 1;
+}
+
+void mergeRunClose(MergeRun *run) {
+    if (run->file == NULL) {
+        return;
+    }
+    if (!run->binary) lineReaderFree(&run->reader);
+    fclose(run->file);
+#if defined(__linux__)
+    if (run->mapped > 0) {
+        munmap(run->data, run->mapped);
+        run->data = NULL;
+    }
+#endif
+    free(run->data);
+}
+
+// Copy the name at offset in the run's pool; 0 if it doesn't end inside the pool or doesn't fit a record
+int mergeRunName(const MergeRun *run, size_t offset, char *name, size_t size) {
+    if (offset >= run->poolSize) {
+        return 0;
+    }
+    const char *start = (const char *)run->data + run->poolOffset + offset;
+    const char *end = memchr(start, '\0', run->poolSize - offset);
+    if (end == NULL || (size_t)(end - start) >= size) {
+        return 0;
+    }
+    memcpy(name, start, (size_t)(end - start) + 1);
+    return 1;
+}
+
+// Load the next record of the run into head. Error lines of text runs are passed to errors.
+int mergeRunAdvance(MergeRun *run, OutputBuffer *errors, FILE *errorFile) {
+    Student *student = &run->head;
+    run->hasHead = 0;
+
+    if (run->binary) {
+        if (run->next >= run->recordCount) {
+            return 0;
+        }
+        const unsigned char *record = run->data + 16 + run->next++ * BINARY_RECORD_SIZE;
+        union { float f; unsigned int u; } gpaBits;
+        if (!mergeRunName(run, (size_t)readLittleEndian(record, 4), student->firstName, sizeof(student->firstName)) ||
+            !mergeRunName(run, (size_t)readLittleEndian(record + 4, 4), student->lastName, sizeof(student->lastName)) ||
+            (record[16] != 'D' && record[16] != 'I')) {
+            fprintf(stderr, "Error: Invalid record in run %s\n", run->path);
+            run->corrupt = 1;
+            return 0;
+        }
+        student->year = (short)readLittleEndian(record + 8, 2);
+        student->month = (char)readLittleEndian(record + 10, 1);
+        student->day = (int)readLittleEndian(record + 11, 1);
+        gpaBits.u = (unsigned int)readLittleEndian(record + 12, 4);
+        student->gpa = gpaBits.f;
+        student->status = (char)record[16];
+        student->toefl = student->status == 'I' ? (int)readLittleEndian(record + 20, 4) : -1;
+        run->hasHead = 1;
+        return 1;
+    }
+
+    char *line;
+    size_t length;
+    int status;
+    while ((status = lineReaderNext(&run->reader, &line, &length)) != 0) {
+        if (status > 0 && strncmp(line, "Error:", 6) == 0) {
+            if (errors != NULL) {
+                rosterAppendBytes(errors, line, length);
+                rosterAppendChar(errors, '\n');
+            } else {
+                fprintf(errorFile, "%s\n", line);
+            }
+            continue;
+        }
+        char birthDigits[50];
+        int day = 0, month = -1, year = 0;
+        student->toefl = -1;
+        int fields = status > 0 ? sscanf(line, "%49s %49s %f %49s %c %d", student->firstName, student->lastName,
+                                         &student->gpa, birthDigits, &student->status, &student->toefl)
+                                : 0;
+        if (fields >= 4) {
+            rosterDivideBirthDigits(birthDigits, &day, &month, &year);
+        }
+        if (fields < 5 || month == -1 || (student->status != 'D' && student->status != 'I') ||
+            (student->status == 'I' && fields != 6)) {
+            fprintf(stderr, "Error: Invalid record in run %s\n", run->path);
+            continue;
+        }
+        student->year = (short)year;
+        student->month = (char)month;
+        student->day = day;
+        run->hasHead = 1;
+        return 1;
+    }
+    return 0;
+}
+
+// Run a orders before run b; equal records keep run order, which is input order. Text runs only carry
+// the printed GPA, so when any run is text every GPA is compared at the printed precision.
+// Checkpoint runs are binary and keep the exact order.
+int mergeRunLess(const MergeRun *runs, int a, int b, int printedGpa) {
+    const Student *first = &runs[a].head, *second = &runs[b].head;
+    int comparison;
+    if (printedGpa && first->gpa != second->gpa && rosterGpaBucket(first->gpa) == rosterGpaBucket(second->gpa)) {
+        Student rounded = *second;
+        rounded.gpa = first->gpa;
+        comparison = compareStudentRecords(NULL, first, &rounded);
+    } else {
+        comparison = compareStudentRecords(NULL, first, second);
+    }
+    return comparison < 0 || (comparison == 0 && a < b);
+}
+
+void mergeHeapDown(const MergeRun *runs, int *heap, int heapSize, int slot, int printedGpa) {
+    for (;;) {
+        int smallest = slot, left = 2 * slot + 1, right = left + 1;
+        if (left < heapSize && mergeRunLess(runs, heap[left], heap[smallest], printedGpa)) smallest = left;
+        if (right < heapSize && mergeRunLess(runs, heap[right], heap[smallest], printedGpa)) smallest = right;
+        if (smallest == slot) return;
+        int swap = heap[slot];
+        heap[slot] = heap[smallest];
+        heap[smallest] = swap;
+        slot = smallest;
+    }
+}
+
+int mergeRunFiles(char **paths, int runCount, FILE *output, const Options *options) {
+    MergeRun *runs = calloc(runCount, sizeof(MergeRun));
+    int *heap = malloc(runCount * sizeof(int));
+    if (runs == NULL || heap == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+
+    int status = 0, corrupt = 0;
+    RecordWriter writer;
+    rosterRecordWriterInit(&writer, output, options->format);
+    // Each run lists its rejected lines first, so priming every run collects them all in input order
+    OutputBuffer *errors = options->format == FORMAT_TEXT ? &writer.buffer : NULL;
+    for (int i = 0; i < runCount; i++) {
+        if (!mergeRunOpen(&runs[i], paths[i], options->ioBackend, options->maxLineLength)) {
+            fprintf(stderr, "Error: Could not read run %s\n", paths[i]);
+            status = 1;
+            continue;
+        }
+        if (!mergeRunAdvance(&runs[i], errors, stderr) && runs[i].corrupt) {
+            corrupt = 1;
+        }
+    }
+
+    // The record order puts every domestic record before the international ones, as in a single-process run
+    int heapSize = 0, printedGpa = 0;
+    for (int i = 0; i < runCount; i++) {
+        if (runs[i].hasHead) {
+            heap[heapSize++] = i;
+        }
+        if (runs[i].file != NULL && !runs[i].binary) {
+            printedGpa = 1;
+        }
+    }
+    for (int slot = heapSize / 2 - 1; slot >= 0; slot--) {
+        mergeHeapDown(runs, heap, heapSize, slot, printedGpa);
+    }
+    while (!corrupt && heapSize > 0) {
+        MergeRun *run = &runs[heap[0]];
+        if (rosterOptionIncludes(options->option, &run->head)) {
+            rosterRecordWriterAdd(&writer, &run->head);
+        }
+        if (!mergeRunAdvance(run, errors, stderr)) {
+            if (run->corrupt) {
+                corrupt = 1;
+                break;
+            }
+            heap[0] = heap[--heapSize];
+        }
+        mergeHeapDown(runs, heap, heapSize, 0, printedGpa);
+    }
+    checkMemory(rosterRecordWriterFinish(&writer));
+    if (corrupt) {
+        status = 1;
+    }
+
+    for (int i = 0; i < runCount; i++) {
+        if (runs[i].file != NULL) {
+            // A run that failed part way (a read error, corrupt compressed data) left records out
+            if (ferror(runs[i].file)) {
+                fprintf(stderr, "Error: Could not read run %s\n", paths[i]);
+                status = 1;
+            }
+        }
+        mergeRunClose(&runs[i]);
+    }
+    free(heap);
+    free(runs);
+    return status;
+}
+
+// --checkpoint=DIR[:N]: the input is turned into sorted binary runs of N records, each spilled to DIR
+// with its rejected-line messages, then the runs are merged into the output. DIR/state records the
+// input offset parsed, the runs written and the output committed with each run's merge position,
+// and is replaced atomically, so --resume continues from the last consistent point.
+#define CHECKPOINT_DEFAULT_RECORDS 1000000
+
+#ifndef _WIN32
+
+typedef struct {
+    long long inputSize, inputModified;   // identify the input the checkpoint belongs to
+    int option, format;
+    long long parsedOffset;               // input bytes already turned into runs
+    int runCount;
+    int merging;                          // every run is written and the merge has started
+    long long outputBytes;                // output committed by the merge
+    long long *cursors;                   // records of each run already in the committed output
+} CheckpointState;
+
+void checkpointPath(char *path, size_t size, const char *directory, const char *name, int number) {
+    if (number < 0) {
+        snprintf(path, size, "%s/%s", directory, name);
+    } else {
+        snprintf(path, size, "%s/%s.%04d", directory, name, number);
+    }
+}
+
+// Flush a stream and wait until its data is on disk
+int syncStream(FILE *file) {
+    return fflush(file) == 0 && fsync(fileno(file)) == 0;
+}
+
+int checkpointSave(const char *directory, const CheckpointState *state) {
+    char path[4096], temporary[4096];
+    checkpointPath(path, sizeof(path), directory, "state", -1);
+    checkpointPath(temporary, sizeof(temporary), directory, "state.tmp", -1);
+
+    FILE *file = fopen(temporary, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    fprintf(file, "roster-checkpoint 1\ninput %lld %lld\noption %d %d\nparsed %lld\nruns %d\nmerging %d\noutput %lld\ncursors",
+            state->inputSize, state->inputModified, state->option, state->format, state->parsedOffset, state->runCount,
+            state->merging, state->outputBytes);
+    for (int i = 0; i < state->runCount; i++) {
+        fprintf(file, " %lld", state->merging ? state->cursors[i] : 0);
+    }
+    fprintf(file, "\n");
+    int written = syncStream(file);
+    written &= fclose(file) == 0;
+    if (!written || rename(temporary, path) != 0) {
+        return 0;
+    }
+    // The rename itself is only durable once the directory is synced
+    int directoryFd = open(directory, O_RDONLY | O_DIRECTORY);
+    if (directoryFd < 0) {
+        return 0;
+    }
+    written = fsync(directoryFd) == 0;
+    close(directoryFd);
+    return written;
+}
+
+// Returns 1 if a checkpoint was read into state
+int checkpointLoad(const char *directory, CheckpointState *state) {
+    char path[4096];
+    checkpointPath(path, sizeof(path), directory, "state", -1);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    int version = 0;
+    int fields = fscanf(file, "roster-checkpoint %d input %lld %lld option %d %d parsed %lld runs %d merging %d output %lld cursors",
+                        &version, &state->inputSize, &state->inputModified, &state->option, &state->format,
+                        &state->parsedOffset, &state->runCount, &state->merging, &state->outputBytes);
+    int valid = fields == 9 && version == 1 && state->runCount >= 0;
+    if (valid) {
+        state->cursors = calloc(state->runCount + 1, sizeof(long long));
+        if (state->cursors == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        for (int i = 0; i < state->runCount && valid; i++) {
+            valid = fscanf(file, "%lld", &state->cursors[i]) == 1;
+        }
+    }
+    fclose(file);
+    return valid;
+}
+
+// Spill one sorted run and its rejected-line messages, then record it in the state
+int checkpointWriteRun(const char *directory, CheckpointState *state, Roster *roster, FILE *errors) {
+    char path[4096];
+    checkpointPath(path, sizeof(path), directory, "run", state->runCount);
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    checkMemory(rosterSortStudents(roster->students, roster->count, NULL, largeBuffers));
+    RecordWriter writer;
+    rosterRecordWriterInit(&writer, file, FORMAT_BINARY);
+    for (int i = 0; i < roster->count; i++) {
+        rosterRecordWriterAdd(&writer, &roster->students[i]);
+    }
+    checkMemory(rosterRecordWriterFinish(&writer));
+    int written = syncStream(file) && syncStream(errors);
+    written &= fclose(file) == 0;
+    return written;
+}
+
+// Run phase: parse the input from the checkpointed offset into runs of at most interval records
+int checkpointBuildRuns(FILE *input, const char *directory, CheckpointState *state, const Options *options) {
+    LineReader reader;
+    Student student;
+    char *line;
+    size_t length;
+    int result = 1;
+    Roster roster;
+
+    lineReaderInit(&reader, input, options->maxLineLength);
+    if (state->parsedOffset > 0 && !lineReaderSetRange(&reader, state->parsedOffset, -1)) {
+        lineReaderFree(&reader);
+        return 0;
+    }
+    while (result != 0) {
+        char path[4096];
+        checkpointPath(path, sizeof(path), directory, "errors", state->runCount);
+        FILE *errors = fopen(path, "w");
+        if (errors == NULL) {
+            lineReaderFree(&reader);
+            return 0;
+        }
+        checkMemory(rosterInit(&roster, largeBuffers));
+        while (roster.count < options->checkpointRecords && (result = lineReaderNext(&reader, &line, &length)) != 0) {
+            if (result < 0) {
+                reportOversizedLine(errors, options->maxLineLength);
+            } else if (parseStudentLine(line, errors, &student) && rosterOptionIncludes(options->option, &student)) {
+                checkMemory(rosterAdd(&roster, &student));
+            }
+        }
+        long long offset = reader.base + (long long)reader.start;
+        // Input that ended exactly on a run boundary: nothing is left for another run
+        if (result == 0 && roster.count == 0 && ftello(errors) == 0 && state->runCount > 0) {
+            fclose(errors);
+            unlink(path);
+            rosterFree(&roster);
+            break;
+        }
+        // A read error leaves this run incomplete, so it is not committed
+        int written = !ferror(input) && checkpointWriteRun(directory, state, &roster, errors);
+        written &= fclose(errors) == 0;
+        rosterFree(&roster);
+        if (!written) {
+            lineReaderFree(&reader);
+            return 0;
+        }
+        state->runCount++;
+        state->parsedOffset = offset;
+        if (!checkpointSave(directory, state)) {
+            lineReaderFree(&reader);
+            return 0;
+        }
+    }
+    lineReaderFree(&reader);
+    return 1;
+}
+
+// Copy every run's rejected-line messages, in input order
+int checkpointCopyErrors(const char *directory, int runCount, FILE *output) {
+    char buffer[1 << 16];
+    for (int i = 0; i < runCount; i++) {
+        char path[4096];
+        checkpointPath(path, sizeof(path), directory, "errors", i);
+        FILE *errors = fopen(path, "r");
+        if (errors == NULL) {
+            return 0;
+        }
+        size_t got;
+        while ((got = fread(buffer, 1, sizeof(buffer), errors)) > 0) {
+            fwrite(buffer, 1, got, output);
+        }
+        fclose(errors);
+    }
+    return 1;
+}
+
+// Commit everything written so far together with each run's merge position
+int checkpointCommitOutput(const char *directory, CheckpointState *state, RecordWriter *writer, const MergeRun *runs) {
+    checkMemory(rosterRecordWriterFlush(writer));
+    if (!syncStream(writer->file)) {
+        return 0;
+    }
+    state->outputBytes = ftello(writer->file);
+    for (int i = 0; i < state->runCount; i++) {
+        state->cursors[i] = runs[i].hasHead ? (long long)runs[i].next - 1 : (long long)runs[i].next;
+    }
+    return checkpointSave(directory, state);
+}
+
+// Merge phase: resumes from the committed output length and run positions. The binary output
+// format keeps its string pool until the end, so it always restarts the merge.
+int checkpointMerge(const char *outputPath, const char *directory, CheckpointState *state, const Options *options) {
+    int resuming = state->merging && options->format != FORMAT_BINARY;
+    FILE *output = fopen(outputPath, resuming ? "r+" : "w");
+    if (output == NULL || (resuming && (ftruncate(fileno(output), (off_t)state->outputBytes) != 0 ||
+                                        fseeko(output, 0, SEEK_END) != 0))) {
+        printf("Error: Could not open output file\n");
+        if (output != NULL) fclose(output);
+        return 1;
+    }
+
+    RecordWriter writer;
+    rosterRecordWriterInit(&writer, output, options->format);
+    if (resuming) {
+        // The header is already in the committed output
+        writer.buffer.length = 0;
+    } else {
+        if (!checkpointCopyErrors(directory, state->runCount, options->format == FORMAT_TEXT ? output : stderr)) {
+            fprintf(stderr, "Error: Could not read checkpoint in %s\n", directory);
+            fclose(output);
+            return 1;
+        }
+        for (int i = 0; i < state->runCount; i++) {
+            state->cursors[i] = 0;
+        }
+        state->merging = 1;
+    }
+
+    MergeRun *runs = calloc(state->runCount + 1, sizeof(MergeRun));
+    int *heap = malloc((state->runCount + 1) * sizeof(int));
+    char (*paths)[4096] = malloc((state->runCount + 1) * sizeof(*paths));
+    if (runs == NULL || heap == NULL || paths == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    int status = 0, heapSize = 0;
+    for (int i = 0; i < state->runCount; i++) {
+        checkpointPath(paths[i], sizeof(paths[i]), directory, "run", i);
+        if (!mergeRunOpen(&runs[i], paths[i], IO_STDIO, options->maxLineLength) || !runs[i].binary) {
+            fprintf(stderr, "Error: Could not read run %s\n", paths[i]);
+            status = 1;
+            continue;
+        }
+        runs[i].next = (unsigned long long)state->cursors[i];
+        if (mergeRunAdvance(&runs[i], NULL, stderr)) {
+            heap[heapSize++] = i;
+        } else if (runs[i].corrupt) {
+            status = 1;
+        }
+    }
+    if (status == 0 && options->format != FORMAT_BINARY && !checkpointCommitOutput(directory, state, &writer, runs)) {
+        status = 1;
+    }
+
+    for (int slot = heapSize / 2 - 1; slot >= 0; slot--) {
+        mergeHeapDown(runs, heap, heapSize, slot, 0);
+    }
+    long long sinceCommit = 0;
+    while (status == 0 && heapSize > 0) {
+        MergeRun *run = &runs[heap[0]];
+        rosterRecordWriterAdd(&writer, &run->head);
+        if (!mergeRunAdvance(run, NULL, stderr)) {
+            if (run->corrupt) {
+                status = 1;
+                break;
+            }
+            heap[0] = heap[--heapSize];
+        }
+        mergeHeapDown(runs, heap, heapSize, 0, 0);
+        if (++sinceCommit == options->checkpointRecords && options->format != FORMAT_BINARY) {
+            sinceCommit = 0;
+            if (!checkpointCommitOutput(directory, state, &writer, runs)) {
+                status = 1;
+            }
+        }
+    }
+    checkMemory(rosterRecordWriterFinish(&writer));
+    if (!syncStream(output)) {
+        status = 1;
+    }
+    fclose(output);
+
+    for (int i = 0; i < state->runCount; i++) {
+        mergeRunClose(&runs[i]);
+    }
+    free(paths);
+    free(heap);
+    free(runs);
+    if (status != 0) {
+        fprintf(stderr, "Error: Could not write checkpoint in %s\n", directory);
+    }
+    return status;
+}
+
+// Remove the checkpoint once the output is complete
+void checkpointClear(const char *directory, int runCount) {
+    char path[4096];
+    for (int i = 0; i < runCount; i++) {
+        checkpointPath(path, sizeof(path), directory, "run", i);
+        unlink(path);
+        checkpointPath(path, sizeof(path), directory, "errors", i);
+        unlink(path);
+    }
+    checkpointPath(path, sizeof(path), directory, "state", -1);
+    unlink(path);
+}
+
+int processCheckpointed(const char *inputPath, const char *outputPath, const Options *options) {
+    const char *directory = options->checkpointDir;
+    struct stat inputStat;
+    if (mkdir(directory, 0777) != 0 && errno != EEXIST) {
+        printf("Error: Could not create checkpoint directory %s\n", directory);
+        return 1;
+    }
+    FILE *input = openStream(inputPath, "r", options->ioBackend);
+    if (input == NULL || fstat(fileno(input), &inputStat) != 0) {
+        printf("Error: Could not open input file\n");
+        if (input != NULL) fclose(input);
+        return 1;
+    }
+
+    CheckpointState fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.inputSize = (long long)inputStat.st_size;
+    fresh.inputModified = (long long)inputStat.st_mtim.tv_sec * 1000000000LL + inputStat.st_mtim.tv_nsec;
+    fresh.option = options->option;
+    fresh.format = options->format;
+
+    CheckpointState state;
+    memset(&state, 0, sizeof(state));
+    if (options->resume && checkpointLoad(directory, &state)) {
+        if (state.inputSize != fresh.inputSize || state.inputModified != fresh.inputModified ||
+            state.option != fresh.option || state.format != fresh.format) {
+            printf("Error: Checkpoint in %s belongs to another input or option\n", directory);
+            fclose(input);
+            free(state.cursors);
+            return 1;
+        }
+    } else {
+        free(state.cursors);
+        state = fresh;
+    }
+
+    int status = 0;
+    if (!state.merging && !checkpointBuildRuns(input, directory, &state, options)) {
+        if (ferror(input)) {
+            fprintf(stderr, "Error: Could not read the whole input file\n");
+        } else {
+            fprintf(stderr, "Error: Could not write checkpoint in %s\n", directory);
+        }
+        status = 1;
+    }
+    fclose(input);
+    if (status == 0) {
+        long long *cursors = realloc(state.cursors, (state.runCount + 1) * sizeof(long long));
+        if (cursors == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        state.cursors = cursors;
+        status = checkpointMerge(outputPath, directory, &state, options);
+    }
+    if (status == 0) {
+        checkpointClear(directory, state.runCount);
+    }
+    free(state.cursors);
+    return status;
+}
+#endif
+
+// Range partitioning by birth year: partition p of N holds the years
+// [1950 + p * 61 / N, 1950 + (p + 1) * 61 / N), so the files in order are the global order. The
+// files are slices of one output: the first holds the format's header, and in the binary format the
+// last holds every partition's names and the trailer.
+typedef struct {
+    const Student *source;  // the loaded records
+    const int *members;     // indexes into source of this partition's records, in input order
+    int count;
+    int first;              // writes the header
+    unsigned long long poolBase;  // binary format: pool bytes of the partitions before this one
+    const Options *options;
+    char path[4096];
+    FILE *file;             // left open for the trailer, closed by processPartitioned
+    RecordWriter writer;
+    int failed;
+} PartitionJob;
+
+int partitionOfYear(int year, int partitions) {
+    return (year - AGG_FIRST_YEAR) * partitions / AGG_YEARS;
+}
+
+// Sort one partition and write it to its own file
+void *partitionWorker(void *arg) {
+    PartitionJob *job = arg;
+    const Options *options = job->options;
+
+    // Gathered by the thread that sorts them, so the pages are first touched on its node
+    Student *records = rosterLargeAlloc(largeBuffers, (job->count + 1) * sizeof(Student));
+    if (records == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < job->count; i++) {
+        records[i] = job->source[job->members[i]];
+    }
+    if (options->sortPlan.keyCount > 0) {
+        checkMemory(rosterSortStudentsByPlan(records, job->count, &options->sortPlan, largeBuffers));
+    } else {
+        checkMemory(rosterSortStudents(records, job->count, NULL, largeBuffers));
+    }
+
+    job->file = openStream(job->path, "w", options->ioBackend);
+    if (job->file == NULL) {
+        job->failed = 1;
+        rosterLargeFree(largeBuffers, records);
+        return NULL;
+    }
+    if (job->first) {
+        rosterRecordWriterInit(&job->writer, job->file, options->format);
+    } else {
+        rosterRecordWriterInitSlice(&job->writer, options->format, job->poolBase);
+        job->writer.file = job->file;
+    }
+    for (int i = 0; i < job->count; i++) {
+        rosterRecordWriterAdd(&job->writer, &records[i]);
+    }
+    checkMemory(rosterRecordWriterFlush(&job->writer));
+    rosterLargeFree(largeBuffers, records);
+    return NULL;
+}
+
+// File a student belongs to: with both statuses selected the international files follow the domestic ones
+int partitionOfStudent(const Student *student, int partitions, int jobCount) {
+    int statusOffset = (student->status == 'I' && jobCount > partitions) ? partitions : 0;
+    return statusOffset + partitionOfYear(student->year, partitions);
+}
+
+// --partition=year:N: rejected lines go to the main output as usual and the records to
+// <output>.000, <output>.001, ...; option 3 writes N domestic files followed by N international ones
+int processPartitioned(FILE *input, FILE *output, const Options *options) {
+    int option = options->option;
+    int partitions = options->partitions;
+    Roster roster;
+    checkMemory(rosterInit(&roster, largeBuffers));
+    checkMemory(rosterEnableDedup(&roster, options->dedup));
+    loadRoster(input, options->format == FORMAT_TEXT ? output : stderr, &roster, options->maxLineLength);
+    rosterSelect(&roster, option);
+
+    int jobCount = (option == 3 ? 2 : 1) * partitions;
+    PartitionJob *jobs = calloc(jobCount, sizeof(PartitionJob));
+    int *next = calloc(jobCount + 1, sizeof(int));
+    int *members = malloc((roster.count + 1) * sizeof(int));
+    if (jobs == NULL || next == NULL || members == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+
+    // Stable scatter of the record indexes into file order; each worker gathers its own records
+    for (int i = 0; i < roster.count; i++) {
+        next[partitionOfStudent(&roster.students[i], partitions, jobCount) + 1]++;
+    }
+    for (int j = 0; j < jobCount; j++) {
+        next[j + 1] += next[j];
+        jobs[j].source = roster.students;
+        jobs[j].members = members + next[j];
+        jobs[j].count = next[j + 1] - next[j];
+        jobs[j].first = j == 0;
+        jobs[j].options = options;
+        snprintf(jobs[j].path, sizeof(jobs[j].path), "%s.%03d", options->outputPath, j);
+    }
+    for (int i = 0; i < roster.count; i++) {
+        members[next[partitionOfStudent(&roster.students[i], partitions, jobCount)]++] = i;
+    }
+    // Binary names are numbered across the files, continuing from the partitions before
+    unsigned long long poolLength = 0;
+    for (int j = 0; j < jobCount && options->format == FORMAT_BINARY; j++) {
+        jobs[j].poolBase = poolLength;
+        for (int i = 0; i < jobs[j].count; i++) {
+            const Student *student = &roster.students[jobs[j].members[i]];
+            poolLength += strlen(student->firstName) + strlen(student->lastName) + 2;
+        }
+    }
+
+#ifndef _WIN32
+    pthread_t *threads = malloc(jobCount * sizeof(pthread_t));
+    if (threads == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < jobCount; i++) {
+        pthread_create(&threads[i], NULL, partitionWorker, &jobs[i]);
+    }
+    for (int i = 0; i < jobCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+#else
+    for (int i = 0; i < jobCount; i++) {
+        partitionWorker(&jobs[i]);
+    }
+#endif
+
+    int status = 0;
+    for (int i = 0; i < jobCount; i++) {
+        if (jobs[i].failed) {
+            fprintf(stderr, "Error: Could not open output file %s\n", jobs[i].path);
+            status = 1;
+            continue;
+        }
+        RecordWriter *writer = &jobs[i].writer;
+        if (options->format == FORMAT_BINARY && i == jobCount - 1) {
+            for (int j = 0; j < jobCount; j++) {
+                rosterAppendBytes(&writer->buffer, jobs[j].writer.pool.data, jobs[j].writer.pool.length);
+            }
+            rosterAppendLittleEndian(&writer->buffer, (unsigned long long)roster.count, 8);
+            rosterAppendLittleEndian(&writer->buffer, poolLength, 8);
+        }
+        checkMemory(rosterRecordWriterFlush(writer));
+        fclose(jobs[i].file);
+    }
+    for (int i = 0; i < jobCount; i++) {
+        free(jobs[i].writer.buffer.data);
+        free(jobs[i].writer.pool.data);
+    }
+    rosterFree(&roster);
+    free(members);
+    free(next);
+    free(jobs);
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        printf("Error: Insufficient arguments\n");
+        return 1;
+    }
+
+    // Optional flags after the option number
+    Options options;
+    memset(&options, 0, sizeof(options));
+    options.maxLineLength = DEFAULT_MAX_LINE_LENGTH;
+    options.outputPath = argv[2];
+    // Queries keep their own list so argv stays as it was given
+    options.queries = malloc(argc * sizeof(char *));
+    if (options.queries == NULL) {
+        printf("Error: Out of memory\n");
+        return 1;
+    }
+    // assignment2 --merge <output> <option> [flags] run1 run2 ...
+    int merging = strcmp(argv[1], "--merge") == 0;
+    if (merging) {
+        options.mergeRuns = malloc(argc * sizeof(char *));
+        if (options.mergeRuns == NULL) {
+            printf("Error: Out of memory\n");
+            return 1;
+        }
+    }
+    for (int i = 4; i < argc; i++) {
+        if (merging && strncmp(argv[i], "--", 2) != 0) {
+            options.mergeRuns[options.mergeRunCount++] = argv[i];
+        } else if (strncmp(argv[i], "--lookup=", 9) == 0 || strncmp(argv[i], "--range=", 8) == 0 ||
+                   strncmp(argv[i], "--percentile=", 13) == 0 || strncmp(argv[i], "--rank=", 7) == 0) {
+            options.queries[options.queryCount++] = argv[i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            options.servePath = argv[++i];
+        } else if (strcmp(argv[i], "--aggregate") == 0 || strcmp(argv[i], "--aggregate=year") == 0) {
+            options.aggregate = 1;
+        } else if (strcmp(argv[i], "--aggregate=month") == 0) {
+            options.aggregate = 2;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            options.pipelineWorkers = 2;
+        } else if (strncmp(argv[i], "--pipeline=", 11) == 0) {
+            options.pipelineWorkers = atoi(argv[i] + 11);
+            if (options.pipelineWorkers < 1 || options.pipelineWorkers > 64) {
+                printf("Error: Invalid parser count in %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--io=stdio") == 0) {
+            options.ioBackend = IO_STDIO;
+        } else if (strcmp(argv[i], "--io=uring") == 0) {
+            options.ioBackend = IO_URING;
+        } else if (strcmp(argv[i], "--huge-pages") == 0 || strcmp(argv[i], "--huge-pages=transparent") == 0) {
+            options.hugePages = HUGE_PAGES_TRANSPARENT;
+        } else if (strcmp(argv[i], "--huge-pages=explicit") == 0) {
+            options.hugePages = HUGE_PAGES_EXPLICIT;
+        } else if (strcmp(argv[i], "--format=text") == 0) {
+            options.format = FORMAT_TEXT;
+        } else if (strcmp(argv[i], "--format=csv") == 0) {
+            options.format = FORMAT_CSV;
+        } else if (strcmp(argv[i], "--format=jsonl") == 0) {
+            options.format = FORMAT_JSONL;
+        } else if (strcmp(argv[i], "--format=binary") == 0) {
+            options.format = FORMAT_BINARY;
+        } else if (strcmp(argv[i], "--bench-sort") == 0) {
+            options.benchRounds = 5;
+        } else if (strncmp(argv[i], "--bench-sort=", 13) == 0) {
+            options.benchRounds = atoi(argv[i] + 13);
+            if (options.benchRounds < 1) {
+                printf("Error: Invalid round count in %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--sort-by=", 10) == 0) {
+            options.sortSpec = argv[i] + 10;
+            if (!rosterParseSortPlan(options.sortSpec, &options.sortPlan)) {
+                printf("Error: Invalid sort order %s - Expected field[:asc|:desc],... with fields date, year, last, first, gpa, toefl\n", argv[i] + 10);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--max-line=", 11) == 0) {
+            char *end;
+            long long limit = strtoll(argv[i] + 11, &end, 10);
+            if (*end != '\0' || limit < 1) {
+                printf("Error: Invalid line length limit %s\n", argv[i] + 11);
+                return 1;
+            }
+            options.maxLineLength = (size_t)limit;
+        } else if (strncmp(argv[i], "--partition=year:", 17) == 0) {
+            options.partitions = atoi(argv[i] + 17);
+            if (options.partitions < 1 || options.partitions > AGG_YEARS) {
+                printf("Error: Invalid partition count in %s - Expected 1 to %d\n", argv[i], AGG_YEARS);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--shard=", 8) == 0) {
+            if (sscanf(argv[i] + 8, "%d/%d", &options.shardIndex, &options.shardCount) != 2 || options.shardCount < 1 ||
+                options.shardIndex < 0 || options.shardIndex >= options.shardCount) {
+                printf("Error: Invalid shard %s - Expected i/n with 0 <= i < n\n", argv[i] + 8);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--checkpoint=", 13) == 0) {
+            char *separator = strrchr(argv[i] + 13, ':');
+            options.checkpointDir = argv[i] + 13;
+            options.checkpointRecords = CHECKPOINT_DEFAULT_RECORDS;
+            if (separator != NULL) {
+                *separator = '\0';
+                options.checkpointRecords = atoi(separator + 1);
+            }
+            if (*options.checkpointDir == '\0' || options.checkpointRecords < 1) {
+                printf("Error: Invalid checkpoint %s - Expected --checkpoint=DIR[:N]\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            options.resume = 1;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            options.watch = 1;
+        } else if (strncmp(argv[i], "--sample=", 9) == 0) {
+            char *end;
+            long size = strtol(argv[i] + 9, &end, 10);
+            int valid = end != argv[i] + 9 && size >= 1 && size <= SAMPLE_MAX_SIZE;
+            if (valid && *end == ',') {
+                valid = end[1] >= '0' && end[1] <= '9';
+                options.sampleSeed = strtoull(end + 1, &end, 10);
+                options.sampleSeeded = 1;
+                if (strcmp(end, ",sorted") == 0) {
+                    options.sampleSorted = 1;
+                    end += 7;
+                }
+            }
+            if (!valid || *end != '\0') {
+                printf("Error: Invalid sample %s - Expected N[,SEED[,sorted]] with N >= 1\n", argv[i] + 9);
+                return 1;
+            }
+            options.sampleSize = (int)size;
+        } else if (strcmp(argv[i], "--dedup=first") == 0) {
+            options.dedup = DEDUP_FIRST;
+        } else if (strcmp(argv[i], "--dedup=last") == 0) {
+            options.dedup = DEDUP_LAST;
+        } else if (strcmp(argv[i], "--dedup=best-gpa") == 0) {
+            options.dedup = DEDUP_BEST_GPA;
+        } else {
+            printf("Error: Unknown flag %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (options.hugePages != HUGE_PAGES_OFF) {
+#if defined(__linux__)
+        hugePageMode = options.hugePages;
+        static const LargeAllocator hugeAllocator = {hugeAlloc, hugeFree};
+        largeBuffers = &hugeAllocator;
+        atexit(reportHugePages);
+#else
+        fprintf(stderr, "Warning: huge pages not supported on this platform, using regular pages\n");
+#endif
+    }
+    if (options.aggregate && options.format != FORMAT_TEXT) {
+        printf("Error: --aggregate only writes the text format\n");
+        return 1;
+    }
+    for (int i = 0; i < options.queryCount && options.format != FORMAT_TEXT; i++) {
+        if (strncmp(options.queries[i], "--percentile=", 13) == 0 || strncmp(options.queries[i], "--rank=", 7) == 0) {
+            printf("Error: --percentile and --rank only write the text format\n");
+            return 1;
+        }
+    }
+    if (options.aggregate && options.dedup != DEDUP_NONE) {
+        printf("Error: --dedup cannot be combined with --aggregate\n");
+        return 1;
+    }
+    // Query answers, aggregates, server responses and the benchmark have orders of their own
+    if (options.sortPlan.keyCount > 0 && (options.queryCount > 0 || options.aggregate || options.servePath != NULL ||
+                                          options.benchRounds > 0)) {
+        printf("Error: --sort-by cannot be combined with queries, --aggregate, --serve or --bench-sort\n");
+        return 1;
+    }
+    // The benchmark only times the sorts and writes its own report
+    if (options.benchRounds > 0 && (options.dedup != DEDUP_NONE || options.format != FORMAT_TEXT ||
+                                    options.pipelineWorkers > 0)) {
+        printf("Error: --bench-sort cannot be combined with --dedup, --format or --pipeline\n");
+        return 1;
+    }
+    if (options.aggregate && options.queryCount > 0) {
+        printf("Error: --aggregate cannot be combined with queries\n");
+        return 1;
+    }
+    // The server answers in the text format from the whole roster, over its own socket
+    if (options.servePath != NULL && (options.format != FORMAT_TEXT || options.aggregate || options.queryCount > 0 ||
+                                      options.dedup != DEDUP_NONE || options.benchRounds > 0)) {
+        printf("Error: --serve cannot be combined with --format, --aggregate, --dedup, --bench-sort or queries\n");
+        return 1;
+    }
+    // --watch and --serve reread their input with plain stdio
+    if (options.ioBackend == IO_URING && (options.servePath != NULL || options.watch)) {
+        printf("Error: --io=uring cannot be combined with --serve or --watch\n");
+        return 1;
+    }
+
+    if (options.pipelineWorkers > 0 && (options.dedup != DEDUP_NONE || options.aggregate || options.sortPlan.keyCount > 0 ||
+                                        options.queryCount > 0 || options.servePath != NULL)) {
+        printf("Error: --pipeline only applies to the plain sorted output\n");
+        return 1;
+    }
+
+    if (options.partitions > 0 && (options.aggregate || options.queryCount > 0 || options.servePath != NULL ||
+                                   options.pipelineWorkers > 0 || options.benchRounds > 0)) {
+        printf("Error: --partition only applies to the plain sorted output\n");
+        return 1;
+    }
+    // Year ranges only concatenate to the global order if the order starts with the birth date
+    if (options.partitions > 0 && options.sortPlan.keyCount > 0 &&
+        (options.sortPlan.keys[0].descending ||
+         (options.sortPlan.keys[0].field != SORT_KEY_DATE && options.sortPlan.keys[0].field != SORT_KEY_YEAR))) {
+        printf("Error: --partition needs a --sort-by order that starts with date or year ascending\n");
+        return 1;
+    }
+
+    // Shards are merged with the built-in order; duplicates across shards cannot be seen by one shard
+    if (options.shardCount > 0 && (options.dedup != DEDUP_NONE || options.aggregate || options.sortPlan.keyCount > 0 ||
+                                   options.queryCount > 0 || options.servePath != NULL || options.pipelineWorkers > 0 ||
+                                   options.partitions > 0 || options.benchRounds > 0)) {
+        printf("Error: --shard only applies to the plain sorted output\n");
+        return 1;
+    }
+    if (options.sampleSize > 0 && (merging || options.dedup != DEDUP_NONE || options.aggregate || options.queryCount > 0 ||
+                                   options.servePath != NULL || options.pipelineWorkers > 0 || options.partitions > 0 ||
+                                   options.benchRounds > 0 || options.shardCount > 0 || options.checkpointDir != NULL ||
+                                   options.watch)) {
+        printf("Error: --sample cannot be combined with the other modes or with --dedup\n");
+        return 1;
+    }
+    if (options.sampleSize > 0 && !options.sampleSeeded) {
+        // Reported so the sample can be drawn again
+        options.sampleSeed = (unsigned long long)time(NULL);
+        fprintf(stderr, "Sample seed: %llu\n", options.sampleSeed);
+    }
+
+    if (merging) {
+        if (options.mergeRunCount == 0) {
+            printf("Error: --merge needs at least one run\n");
+            return 1;
+        }
+        if (options.dedup != DEDUP_NONE || options.aggregate || options.sortPlan.keyCount > 0 || options.queryCount > 0 ||
+            options.servePath != NULL || options.pipelineWorkers > 0 || options.partitions > 0 ||
+            options.benchRounds > 0 || options.shardCount > 0 || options.watch) {
+            printf("Error: --merge only accepts --format, --io, --max-line and --huge-pages\n");
+            return 1;
+        }
+        FILE *mergeOutput = openStream(argv[2], "w", options.ioBackend);
+        if (mergeOutput == NULL) {
+            printf("Error: Could not open output file\n");
+            return 1;
+        }
+        options.option = atoi(argv[3]);
+        int status = 1;
+        if (options.option < 1 || options.option > 3) {
+            fprintf(mergeOutput, "Error: Invalid option\n");
+        } else {
+            status = mergeRunFiles(options.mergeRuns, options.mergeRunCount, mergeOutput, &options);
+        }
+        fclose(mergeOutput);
+        free(options.mergeRuns);
+        return status;
+    }
+
+    // These modes reopen or reread their files by name
+    if ((strcmp(argv[1], "-") == 0 || strcmp(argv[2], "-") == 0) &&
+        (options.watch || options.servePath != NULL || options.checkpointDir != NULL || options.partitions > 0)) {
+        printf("Error: --watch, --serve, --checkpoint and --partition need named input and output files\n");
+        return 1;
+    }
+
+    if (options.resume && options.checkpointDir == NULL) {
+        printf("Error: --resume needs --checkpoint=DIR\n");
+        return 1;
+    }
+    if (options.checkpointDir != NULL) {
+        if (options.dedup != DEDUP_NONE || options.aggregate || options.sortPlan.keyCount > 0 || options.queryCount > 0 ||
+            options.servePath != NULL || options.pipelineWorkers > 0 || options.partitions > 0 ||
+            options.benchRounds > 0 || options.shardCount > 0 || options.watch) {
+            printf("Error: --checkpoint only applies to the plain sorted output\n");
+            return 1;
+        }
+        options.option = atoi(argv[3]);
+        if (options.option < 1 || options.option > 3) {
+            printf("Error: Invalid option\n");
+            return 1;
+        }
+#ifndef _WIN32
+        return processCheckpointed(argv[1], argv[2], &options);
+#else
+        printf("Error: --checkpoint is not supported on this platform\n");
+        return 1;
+#endif
+    }
+
+    if (options.watch) {
+        if (options.dedup != DEDUP_NONE || options.aggregate || options.sortPlan.keyCount > 0 || options.queryCount > 0 ||
+            options.servePath != NULL || options.pipelineWorkers > 0 || options.partitions > 0 ||
+            options.benchRounds > 0 || options.shardCount > 0) {
+            printf("Error: --watch only applies to the plain sorted output\n");
+            return 1;
+        }
+        options.option = atoi(argv[3]);
+        if (options.option < 1 || options.option > 3) {
+            printf("Error: Invalid option\n");
+            return 1;
+        }
+#ifndef _WIN32
+        return watchRoster(argv[1], argv[2], &options);
+#else
+        printf("Error: --watch is not supported on this platform\n");
+        return 1;
+#endif
+    }
+
+    if (options.servePath != NULL) {
+#ifndef _WIN32
+        return serveRoster(argv[1], &options);
+#else
+        printf("Error: --serve is not supported on this platform\n");
+        return 1;
+#endif
+    }
+
+    // Open input and output files
+    FILE *inputFile = openStream(argv[1], "r", options.ioBackend);
+    if (inputFile == NULL) {
+        printf("Error: Could not open input file\n");
+        return 1;
+    }
+
+    FILE *outputFile = openStream(argv[2], "w", options.ioBackend);
+    if (outputFile == NULL) {
+        printf("Error: Could not open output file\n");
+        fclose(inputFile);
+        return 1;
+    }
+
+    // Get option from command line argument
+    options.option = atoi(argv[3]);
+    if (options.option < 1 || options.option > 3) {
+        fprintf(outputFile, "Error: Invalid option\n");
+        fclose(inputFile);
+        fclose(outputFile);
+        return 1;
+    }
+
+    int status = 0;
+    if (options.benchRounds > 0) {
+        benchmarkSorts(inputFile, outputFile, &options);
+    } else if (options.aggregate) {
+        processAggregate(inputFile, outputFile, &options);
+    } else if (options.sampleSize > 0) {
+        processSample(inputFile, outputFile, &options);
+    } else if (options.queryCount > 0) {
+        status = processQueries(inputFile, outputFile, &options);
+    } else if (options.partitions > 0) {
+        status = processPartitioned(inputFile, outputFile, &options);
+    } else if (options.pipelineWorkers > 0) {
+#ifndef _WIN32
+        processFilePipelined(inputFile, outputFile, &options);
+#else
+        processFile(inputFile, outputFile, &options);
+#endif
+    } else {
+        // Process the file based on the given option
+        status = processFile(inputFile, outputFile, &options);
+    }
+
+    // A read error or corrupt compressed input ends the input early: the output is incomplete
+    if (ferror(inputFile)) {
+        fprintf(stderr, "Error: Could not read the whole input file\n");
+        status = 1;
+    }
+    fclose(inputFile);
+    fclose(outputFile);
+    free(options.queries);
+
+    return status;
+}
 
-    return 0;
-}
\ No newline at end of file
@@ -0,0 +1,1636 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "roster_core.h"
+
+const char* rosterMonthAbbreviation(int month) {
+    const char* months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    if (month >= 1 && month <= 12) {
+        return months[month - 1];
+    }
+    return "Error: Invalid month";
+}
+
+// Jan -> 1, Feb -> 2, etc
+static int getMonthNumber(const char *month) {
+    const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    for (int i = 0; i < 12; i++) {
+        if (strcmp(month, months[i]) == 0) return i + 1;
+    }
+    return -1;
+}
+
+// Function to divide birthdate string into day, month, and year
+void rosterDivideBirthDigits(const char *birthDigits, int *day, int *month, int *year) {
+    char monthStr[4];
+    sscanf(birthDigits, "%3s-%d-%d", monthStr, day, year);
+    *month = getMonthNumber(monthStr);
+}
+
+// Helper function to check if a string is a valid float
+static int isFloat(const char *str) {
+    char *endptr;
+    strtod(str, &endptr);
+    return *endptr == '\0';
+}
+
+// Helper function to check if a string is a valid integer
+static int isInteger(const char *str) {
+    char *endptr;
+    strtol(str, &endptr, 10);
+    return *endptr == '\0';
+}
+
+static int isAlphabet(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+// Code point ranges accepted as name letters outside ASCII: every code point of General Category L*
+// (letters) or Mn/Mc (the combining marks used to spell them) in the Latin, IPA, Greek, Cyrillic,
+// Armenian, Hebrew, Arabic, Indic, Thai, Georgian, Hangul, kana and CJK blocks, from Unicode 14.0.
+// Digits, currency and number signs of those blocks are not letters.
+static const unsigned int nameLetterRanges[][2] = {
+    {0x00AA, 0x00AA}, {0x00B5, 0x00B5}, {0x00BA, 0x00BA}, {0x00C0, 0x00D6}, {0x00D8, 0x00F6},
+    {0x00F8, 0x02C1}, {0x02C6, 0x02D1}, {0x02E0, 0x02E4}, {0x02EC, 0x02EC}, {0x02EE, 0x02EE},
+    {0x0300, 0x0374}, {0x0376, 0x0377}, {0x037A, 0x037D}, {0x037F, 0x037F}, {0x0386, 0x0386},
+    {0x0388, 0x038A}, {0x038C, 0x038C}, {0x038E, 0x03A1}, {0x03A3, 0x03F5}, {0x03F7, 0x0481},
+    {0x0483, 0x0487}, {0x048A, 0x052F}, {0x0531, 0x0556}, {0x0559, 0x0559}, {0x0560, 0x0588},
+    {0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2}, {0x05C4, 0x05C5}, {0x05C7, 0x05C7},
+    {0x05D0, 0x05EA}, {0x05EF, 0x05F2}, {0x0610, 0x061A}, {0x0620, 0x065F}, {0x066E, 0x06D3},
+    {0x06D5, 0x06DC}, {0x06DF, 0x06E8}, {0x06EA, 0x06EF}, {0x06FA, 0x06FC}, {0x06FF, 0x06FF},
+    {0x0900, 0x0963}, {0x0971, 0x0983}, {0x0985, 0x098C}, {0x098F, 0x0990}, {0x0993, 0x09A8},
+    {0x09AA, 0x09B0}, {0x09B2, 0x09B2}, {0x09B6, 0x09B9}, {0x09BC, 0x09C4}, {0x09C7, 0x09C8},
+    {0x09CB, 0x09CE}, {0x09D7, 0x09D7}, {0x09DC, 0x09DD}, {0x09DF, 0x09E3}, {0x09F0, 0x09F1},
+    {0x09FC, 0x09FC}, {0x09FE, 0x09FE}, {0x0A01, 0x0A03}, {0x0A05, 0x0A0A}, {0x0A0F, 0x0A10},
+    {0x0A13, 0x0A28}, {0x0A2A, 0x0A30}, {0x0A32, 0x0A33}, {0x0A35, 0x0A36}, {0x0A38, 0x0A39},
+    {0x0A3C, 0x0A3C}, {0x0A3E, 0x0A42}, {0x0A47, 0x0A48}, {0x0A4B, 0x0A4D}, {0x0A51, 0x0A51},
+    {0x0A59, 0x0A5C}, {0x0A5E, 0x0A5E}, {0x0A70, 0x0A75}, {0x0A81, 0x0A83}, {0x0A85, 0x0A8D},
+    {0x0A8F, 0x0A91}, {0x0A93, 0x0AA8}, {0x0AAA, 0x0AB0}, {0x0AB2, 0x0AB3}, {0x0AB5, 0x0AB9},
+    {0x0ABC, 0x0AC5}, {0x0AC7, 0x0AC9}, {0x0ACB, 0x0ACD}, {0x0AD0, 0x0AD0}, {0x0AE0, 0x0AE3},
+    {0x0AF9, 0x0AFF}, {0x0B01, 0x0B03}, {0x0B05, 0x0B0C}, {0x0B0F, 0x0B10}, {0x0B13, 0x0B28},
+    {0x0B2A, 0x0B30}, {0x0B32, 0x0B33}, {0x0B35, 0x0B39}, {0x0B3C, 0x0B44}, {0x0B47, 0x0B48},
+    {0x0B4B, 0x0B4D}, {0x0B55, 0x0B57}, {0x0B5C, 0x0B5D}, {0x0B5F, 0x0B63}, {0x0B71, 0x0B71},
+    {0x0B82, 0x0B83}, {0x0B85, 0x0B8A}, {0x0B8E, 0x0B90}, {0x0B92, 0x0B95}, {0x0B99, 0x0B9A},
+    {0x0B9C, 0x0B9C}, {0x0B9E, 0x0B9F}, {0x0BA3, 0x0BA4}, {0x0BA8, 0x0BAA}, {0x0BAE, 0x0BB9},
+    {0x0BBE, 0x0BC2}, {0x0BC6, 0x0BC8}, {0x0BCA, 0x0BCD}, {0x0BD0, 0x0BD0}, {0x0BD7, 0x0BD7},
+    {0x0C00, 0x0C0C}, {0x0C0E, 0x0C10}, {0x0C12, 0x0C28}, {0x0C2A, 0x0C39}, {0x0C3C, 0x0C44},
+    {0x0C46, 0x0C48}, {0x0C4A, 0x0C4D}, {0x0C55, 0x0C56}, {0x0C58, 0x0C5A}, {0x0C5D, 0x0C5D},
+    {0x0C60, 0x0C63}, {0x0C80, 0x0C83}, {0x0C85, 0x0C8C}, {0x0C8E, 0x0C90}, {0x0C92, 0x0CA8},
+    {0x0CAA, 0x0CB3}, {0x0CB5, 0x0CB9}, {0x0CBC, 0x0CC4}, {0x0CC6, 0x0CC8}, {0x0CCA, 0x0CCD},
+    {0x0CD5, 0x0CD6}, {0x0CDD, 0x0CDE}, {0x0CE0, 0x0CE3}, {0x0CF1, 0x0CF2}, {0x0D00, 0x0D0C},
+    {0x0D0E, 0x0D10}, {0x0D12, 0x0D44}, {0x0D46, 0x0D48}, {0x0D4A, 0x0D4E}, {0x0D54, 0x0D57},
+    {0x0D5F, 0x0D63}, {0x0D7A, 0x0D7F}, {0x0D81, 0x0D83}, {0x0D85, 0x0D96}, {0x0D9A, 0x0DB1},
+    {0x0DB3, 0x0DBB}, {0x0DBD, 0x0DBD}, {0x0DC0, 0x0DC6}, {0x0DCA, 0x0DCA}, {0x0DCF, 0x0DD4},
+    {0x0DD6, 0x0DD6}, {0x0DD8, 0x0DDF}, {0x0DF2, 0x0DF3}, {0x0E01, 0x0E3A}, {0x0E40, 0x0E4E},
+    {0x10A0, 0x10C5}, {0x10C7, 0x10C7}, {0x10CD, 0x10CD}, {0x10D0, 0x10FA}, {0x10FC, 0x11FF},
+    {0x1DC0, 0x1F15}, {0x1F18, 0x1F1D}, {0x1F20, 0x1F45}, {0x1F48, 0x1F4D}, {0x1F50, 0x1F57},
+    {0x1F59, 0x1F59}, {0x1F5B, 0x1F5B}, {0x1F5D, 0x1F5D}, {0x1F5F, 0x1F7D}, {0x1F80, 0x1FB4},
+    {0x1FB6, 0x1FBC}, {0x1FBE, 0x1FBE}, {0x1FC2, 0x1FC4}, {0x1FC6, 0x1FCC}, {0x1FD0, 0x1FD3},
+    {0x1FD6, 0x1FDB}, {0x1FE0, 0x1FEC}, {0x1FF2, 0x1FF4}, {0x1FF6, 0x1FFC}, {0x3041, 0x3096},
+    {0x3099, 0x309A}, {0x309D, 0x309F}, {0x30A1, 0x30FA}, {0x30FC, 0x30FF}, {0x3400, 0x4DBF},
+    {0x4E00, 0x9FFF}, {0xAC00, 0xD7A3}, {0xF900, 0xFA6D}, {0xFA70, 0xFAD9}, {0x20000, 0x2A6DF},
+};
+
+// The combining marks among the name letters (General Category Mn/Mc, the same blocks): vowel signs,
+// viramas and accents attach to the letter before them, so a name can't start with one
+static const unsigned int combiningMarkRanges[][2] = {
+    {0x0300, 0x036F}, {0x0483, 0x0487}, {0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2},
+    {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A}, {0x064B, 0x065F}, {0x0670, 0x0670},
+    {0x06D6, 0x06DC}, {0x06DF, 0x06E4}, {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0900, 0x0903},
+    {0x093A, 0x093C}, {0x093E, 0x094F}, {0x0951, 0x0957}, {0x0962, 0x0963}, {0x0981, 0x0983},
+    {0x09BC, 0x09BC}, {0x09BE, 0x09C4}, {0x09C7, 0x09C8}, {0x09CB, 0x09CD}, {0x09D7, 0x09D7},
+    {0x09E2, 0x09E3}, {0x09FE, 0x09FE}, {0x0A01, 0x0A03}, {0x0A3C, 0x0A3C}, {0x0A3E, 0x0A42},
+    {0x0A47, 0x0A48}, {0x0A4B, 0x0A4D}, {0x0A51, 0x0A51}, {0x0A70, 0x0A71}, {0x0A75, 0x0A75},
+    {0x0A81, 0x0A83}, {0x0ABC, 0x0ABC}, {0x0ABE, 0x0AC5}, {0x0AC7, 0x0AC9}, {0x0ACB, 0x0ACD},
+    {0x0AE2, 0x0AE3}, {0x0AFA, 0x0AFF}, {0x0B01, 0x0B03}, {0x0B3C, 0x0B3C}, {0x0B3E, 0x0B44},
+    {0x0B47, 0x0B48}, {0x0B4B, 0x0B4D}, {0x0B55, 0x0B57}, {0x0B62, 0x0B63}, {0x0B82, 0x0B82},
+    {0x0BBE, 0x0BC2}, {0x0BC6, 0x0BC8}, {0x0BCA, 0x0BCD}, {0x0BD7, 0x0BD7}, {0x0C00, 0x0C04},
+    {0x0C3C, 0x0C3C}, {0x0C3E, 0x0C44}, {0x0C46, 0x0C48}, {0x0C4A, 0x0C4D}, {0x0C55, 0x0C56},
+    {0x0C62, 0x0C63}, {0x0C81, 0x0C83}, {0x0CBC, 0x0CBC}, {0x0CBE, 0x0CC4}, {0x0CC6, 0x0CC8},
+    {0x0CCA, 0x0CCD}, {0x0CD5, 0x0CD6}, {0x0CE2, 0x0CE3}, {0x0D00, 0x0D03}, {0x0D3B, 0x0D3C},
+    {0x0D3E, 0x0D44}, {0x0D46, 0x0D48}, {0x0D4A, 0x0D4D}, {0x0D57, 0x0D57}, {0x0D62, 0x0D63},
+    {0x0D81, 0x0D83}, {0x0DCA, 0x0DCA}, {0x0DCF, 0x0DD4}, {0x0DD6, 0x0DD6}, {0x0DD8, 0x0DDF},
+    {0x0DF2, 0x0DF3}, {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1DC0, 0x1DFF},
+    {0x3099, 0x309A},
+};
+
+static int inCodePointRanges(const unsigned int (*ranges)[2], int count, unsigned int codePoint) {
+    int low = 0, high = count - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (codePoint < ranges[middle][0]) {
+            high = middle - 1;
+        } else if (codePoint > ranges[middle][1]) {
+            low = middle + 1;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int isNameLetter(unsigned int codePoint) {
+    return inCodePointRanges(nameLetterRanges, (int)(sizeof(nameLetterRanges) / sizeof(nameLetterRanges[0])), codePoint);
+}
+
+static int isCombiningMark(unsigned int codePoint) {
+    return inCodePointRanges(combiningMarkRanges, (int)(sizeof(combiningMarkRanges) / sizeof(combiningMarkRanges[0])),
+                             codePoint);
+}
+
+// Decode one UTF-8 sequence; rejects truncated, overlong and surrogate encodings.
+// Returns the sequence length, or 0 if it is malformed.
+static int decodeUtf8(const unsigned char *text, size_t available, unsigned int *codePoint) {
+    unsigned char lead = text[0];
+    size_t length;
+    unsigned int value, minimum;
+
+    if (lead < 0x80) {
+        *codePoint = lead;
+        return 1;
+    } else if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2, value = lead & 0x1F, minimum = 0x80;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3, value = lead & 0x0F, minimum = 0x800;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4, value = lead & 0x07, minimum = 0x10000;
+    } else {
+        return 0;
+    }
+    if (length > available) {
+        return 0;
+    }
+    for (size_t i = 1; i < length; i++) {
+        if ((text[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        value = (value << 6) | (text[i] & 0x3F);
+    }
+    if (value < minimum || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) {
+        return 0;
+    }
+    *codePoint = value;
+    return (int)length;
+}
+
+// A name is well-formed UTF-8 made only of letters, not starting with a combining mark. ASCII runs are checked 16 bytes at a time.
+static int isValidName(const char *name) {
+    const unsigned char *text = (const unsigned char *)name;
+    size_t length = strlen(name), position = 0;
+
+    while (position < length) {
+#ifdef __SSE2__
+        if (length - position >= 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(text + position));
+            if (_mm_movemask_epi8(chunk) == 0) {
+                // All ASCII: every byte must fold to 'a'..'z'
+                __m128i folded = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+                __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)),
+                                                _mm_cmplt_epi8(folded, _mm_set1_epi8('z' + 1)));
+                if (_mm_movemask_epi8(letters) != 0xFFFF) {
+                    return 0;
+                }
+                position += 16;
+                continue;
+            }
+        }
+#endif
+        if (text[position] < 0x80) {
+            if (!isAlphabet((char)text[position])) {
+                return 0;
+            }
+            position++;
+            continue;
+        }
+        unsigned int codePoint;
+        int sequence = decodeUtf8(text + position, length - position, &codePoint);
+        if (sequence == 0 || !isNameLetter(codePoint) || (position == 0 && isCombiningMark(codePoint))) {
+            return 0;
+        }
+        position += sequence;
+    }
+    return 1;
+}
+
+// Function to validate line format with specific error reporting (the reason is written to detail)
+static int validateLineFormat(const char *line, int *requiresTOEFL, char *detail, size_t detailSize) {
+    char birthDigits[50], firstName[50], lastName[50], gpaStr[20], statusChar, toeflStr[20];
+    int fieldsRead;
+
+    // A field longer than its buffer would be cut and the rest read as the next field; names are
+    // capped at ROSTER_NAME_MAX_BYTES
+    static const char *const fieldNames[] = {"first name", "last name", "birth date", "GPA"};
+    static const size_t fieldLimits[] = {sizeof(firstName) - 1, sizeof(lastName) - 1, sizeof(birthDigits) - 1,
+                                         sizeof(gpaStr) - 1};
+    const char *field = line;
+    for (int i = 0; i < 4; i++) {
+        while (isspace((unsigned char)*field)) field++;
+        size_t length = 0;
+        while (field[length] != '\0' && !isspace((unsigned char)field[length])) length++;
+        if (length > fieldLimits[i]) {
+            snprintf(detail, detailSize, "Error: Invalid %s - Longer than %zu bytes\n", fieldNames[i], fieldLimits[i]);
+            return 0;
+        }
+        field += length;
+    }
+
+    // Attempt to parse the line into components
+    fieldsRead = sscanf(line, "%49s %49s %49s %19s %c %19s", firstName, lastName, birthDigits, gpaStr, &statusChar, toeflStr);
+
+    // Check if we have at least 4 fields
+    if (fieldsRead < 5) {
+        snprintf(detail, detailSize, "Error: Line must contain at least 5 fields (FirstName LastName BirthDate GPA Status)\n");
+        return 0;
+    }
+
+    // Check if the name fields are made of letters (UTF-8)
+    if (!isValidName(firstName)) {
+        snprintf(detail, detailSize, "Error: Invalid first name - Contains non-alphabetical characters: %s\n", firstName);
+        return 0;
+    }
+    if (!isValidName(lastName)) {
+        snprintf(detail, detailSize, "Error: Invalid last name - Contains non-alphabetical characters: %s\n", lastName);
+        return 0;
+    }
+
+    // Check if GPA is a valid float and within the range 0.0 to 4.3
+    float gpa = atof(gpaStr);
+    if (!isFloat(gpaStr) || gpa < 0.0 || gpa > 4.3) {
+        snprintf(detail, detailSize, "Error: Invalid GPA - Not in range 0.0 to 4.3: %s\n", gpaStr);
+        return 0;
+    }
+
+    // Check if status is either 'I' or 'D'
+    if (statusChar != 'I' && statusChar != 'D') {
+        snprintf(detail, detailSize, "Error: Invalid status - Expected 'I' or 'D', found: %c\n", statusChar);
+        return 0;
+    }
+
+    // If status is 'I', ensure TOEFL score is provided and valid
+    if (statusChar == 'I') {
+        *requiresTOEFL = 1;
+        if (fieldsRead != 6 || !isInteger(toeflStr)) {
+            snprintf(detail, detailSize, "Error: Invalid TOEFL score - Expected an integer: %s\n", toeflStr);
+            return 0;
+        }
+    } else {
+        *requiresTOEFL = 0;
+        if (fieldsRead > 5) {
+            snprintf(detail, detailSize, "Error: Extra arguments found for 'D' status\n");
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Function to compare two students based on the sorting criteria
+int rosterCompareStudents(const void *a, const void *b) {
+    const Student *studentA = a;
+    const Student *studentB = b;
+
+    // Domestic students take precedence over international
+    if (studentA->status != studentB->status) {
+        return (studentA->status == 'D') ? -1 : 1;
+    }
+
+    // Compare by year, month, day of birth
+    if (studentA->year != studentB->year) return studentA->year - studentB->year;
+    if (studentA->month != studentB->month) return studentA->month - studentB->month;
+    if (studentA->day != studentB->day) return studentA->day - studentB->day;
+
+    // Compare by last name
+    int lastNameComparison = strcmp(studentA->lastName, studentB->lastName);
+    if (lastNameComparison != 0) {
+        return lastNameComparison;
+    }
+
+    // Compare by first name
+    int firstNameComparison = strcmp(studentA->firstName, studentB->firstName);
+    if (firstNameComparison != 0) {
+        return firstNameComparison;
+    }
+
+    // Compare by GPA
+    if (studentA->gpa != studentB->gpa) {
+        return (studentA->gpa > studentB->gpa) ? -1 : 1; // Higher GPA comes first
+    }
+
+    // Compare by TOEFL if available (both have the same status here)
+    if (studentA->status == 'I') {
+        return studentB->toefl - studentA->toefl;
+    }
+
+    return 0;
+}
+
+// malloc for buffers that may be large, unless allocator says otherwise; free with rosterLargeFree
+void *rosterLargeAlloc(const LargeAllocator *allocator, size_t bytes) {
+    if (bytes == 0) {
+        bytes = 1;
+    }
+    return allocator != NULL && allocator->allocate != NULL ? allocator->allocate(bytes) : malloc(bytes);
+}
+
+void rosterLargeFree(const LargeAllocator *allocator, void *buffer) {
+    if (buffer == NULL) {
+        return;
+    }
+    if (allocator != NULL && allocator->allocate != NULL) {
+        allocator->release(buffer);
+    } else {
+        free(buffer);
+    }
+}
+
+void *rosterLargeRealloc(const LargeAllocator *allocator, void *buffer, size_t oldBytes, size_t newBytes) {
+    if (allocator == NULL || allocator->allocate == NULL) {
+        return realloc(buffer, newBytes);
+    }
+    void *grown = rosterLargeAlloc(allocator, newBytes);
+    if (grown != NULL && buffer != NULL) {
+        memcpy(grown, buffer, oldBytes < newBytes ? oldBytes : newBytes);
+        rosterLargeFree(allocator, buffer);
+    }
+    return grown;
+}
+
+DEFINE_TIM_SORT(rosterSortStudents, Student, compareStudentRecords)
+
+// Whether the output option (1 domestic, 2 international, 3 both) includes the student
+int rosterOptionIncludes(int option, const Student *student) {
+    return student->status == 'I' ? option != 1 : option != 2;
+}
+
+// Pack a birth date into a single integer that orders the same way as the date
+static int dateKey(int year, int month, int day) {
+    return year * 10000 + month * 100 + day;
+}
+
+// |value| in thousandths, rounded the way it is printed: half to even on the exact binary value
+static long long roundThousandths(float value) {
+    double scaled = fabs((double)value) * 1000.0;
+    double whole = floor(scaled);
+    double fraction = scaled - whole;
+    long long thousandths = (long long)whole;
+    if (fraction > 0.5 || (fraction == 0.5 && (thousandths & 1))) {
+        thousandths++;
+    }
+    return thousandths;
+}
+
+// The GPA as printed, in thousandths
+int rosterGpaBucket(float gpa) {
+    if (!(gpa > 0.0f)) return 0;
+    long long bucket = roundThousandths(gpa);
+    if (bucket >= GPA_BUCKETS) return GPA_BUCKETS - 1;
+    return (int)bucket;
+}
+
+// Parse and validate one input line into a student record.
+// Returns 1 for a valid record, 0 if the line was rejected: the error line is written to message and
+// the validator's reason, if any, to detail (both newline-terminated, detail empty otherwise).
+int rosterParseStudentRecord(const char *line, Student *student, char *message, size_t messageSize, char *detail,
+                       size_t detailSize) {
+    char firstName[50], lastName[50], birthDigits[50];
+    float gpa = 0.0;
+    char status;
+    int toefl = -1;
+    int requiresTOEFL = 0;
+
+    //Validate the format of the line
+    detail[0] = '\0';
+    if (!validateLineFormat(line, &requiresTOEFL, detail, detailSize)) {
+        // If validation fails, stop processing this line
+        snprintf(message, messageSize, "Error: Invalid format\n");
+        return 0;
+    }
+
+    // Parse the line based on whether TOEFL is required or not
+    int fieldsRead;
+    if (requiresTOEFL) {
+        fieldsRead = sscanf(line, "%49s %49s %49s %f %c %d", firstName, lastName, birthDigits, &gpa, &status, &toefl);
+    } else {
+        fieldsRead = sscanf(line, "%49s %49s %49s %f %c", firstName, lastName, birthDigits, &gpa, &status);
+    }
+
+    // Extract day, month, and year from birthDigits
+    int day = 0, month = 0, year = 0;
+    rosterDivideBirthDigits(birthDigits, &day, &month, &year);
+
+    // Ensure valid month and year ranges
+    if (month == -1 || year < 1950 || year > 2010) {
+        snprintf(message, messageSize, "Error: Invalid birth date\n");
+        return 0;
+    }
+
+    // Check if the status is 'I' or 'D'
+    if (status != 'I' && status != 'D') {
+        snprintf(message, messageSize, "Error: Invalid status - Expected 'I' or 'D'\n");
+        return 0;
+    }
+
+    if (status == 'D' && fieldsRead > 5) {
+        snprintf(message, messageSize, "Error: Extra arguments found for domestic student\n");
+        return 0;
+    }
+    if (status == 'I' && fieldsRead != 6) {
+        snprintf(message, messageSize, "Error: Missing TOEFL score for international student\n");
+        return 0;
+    }
+
+    strcpy(student->firstName, firstName);
+    strcpy(student->lastName, lastName);
+    student->day = day;
+    student->month = month;
+    student->year = year;
+    student->gpa = gpa;
+    student->status = status;
+    student->toefl = (status == 'I') ? toefl : -1;
+    return 1;
+}
+
+// FNV-1a over "lastName\0firstName"
+static unsigned int hashName(const char *lastName, const char *firstName) {
+    unsigned int hash = 2166136261u;
+    for (const char *p = lastName; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    hash = (hash ^ 0) * 16777619u;
+    for (const char *p = firstName; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return hash;
+}
+
+static void indexInsertSlot(int *slots, int slotCount, unsigned int hash, int entry) {
+    unsigned int mask = (unsigned int)slotCount - 1;
+    unsigned int pos = hash & mask;
+    while (slots[pos] != -1) {
+        pos = (pos + 1) & mask;
+    }
+    slots[pos] = entry;
+}
+
+static int indexAddStudent(Roster *roster, int entry) {
+    StudentIndex *index = roster->index;
+
+    // Keep the load factor at or below one half
+    if ((index->used + 1) * 2 > index->slotCount) {
+        int newCount = index->slotCount * 2;
+        int *newSlots = malloc(newCount * sizeof(int));
+        if (newSlots == NULL) {
+            return -1;
+        }
+        for (int i = 0; i < newCount; i++) {
+            newSlots[i] = -1;
+        }
+        for (int i = 0; i < index->slotCount; i++) {
+            if (index->slots[i] != -1) {
+                const Student *s = &roster->students[index->slots[i]];
+                indexInsertSlot(newSlots, newCount, hashName(s->lastName, s->firstName), index->slots[i]);
+            }
+        }
+        free(index->slots);
+        index->slots = newSlots;
+        index->slotCount = newCount;
+    }
+
+    const Student *s = &roster->students[entry];
+    indexInsertSlot(index->slots, index->slotCount, hashName(s->lastName, s->firstName), entry);
+    index->used++;
+    return 0;
+}
+
+static inline int compareDateIndexEntries(void *context, const DateIndexEntry *a, const DateIndexEntry *b) {
+    (void)context;
+    if (a->dateKey != b->dateKey) return (a->dateKey < b->dateKey) ? -1 : 1;
+    return 0;
+}
+
+// Declared static first, so the instantiation below keeps internal linkage
+static int sortDateIndex(DateIndexEntry *array, size_t count, void *context, const LargeAllocator *allocator);
+DEFINE_TIM_SORT(sortDateIndex, DateIndexEntry, compareDateIndexEntries)
+
+// Build the birth date index once all records are loaded
+int rosterIndexBuildDateOrder(Roster *roster) {
+    StudentIndex *index = roster->index;
+
+    index->byDate = rosterLargeAlloc(roster->allocator, (roster->count + 1) * sizeof(DateIndexEntry));
+    if (index->byDate == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < roster->count; i++) {
+        const Student *s = &roster->students[i];
+        index->byDate[i].dateKey = dateKey(s->year, s->month, s->day);
+        index->byDate[i].index = i;
+    }
+    return sortDateIndex(index->byDate, roster->count, NULL, roster->allocator);
+}
+
+int rosterInit(Roster *roster, const LargeAllocator *allocator) {
+    memset(roster, 0, sizeof(*roster));
+    roster->allocator = allocator;
+    roster->capacity = MAX_STUDENTS;
+    roster->students = rosterLargeAlloc(allocator, roster->capacity * sizeof(Student));
+    return roster->students != NULL ? 0 : -1;
+}
+
+int rosterEnableIndex(Roster *roster) {
+    StudentIndex *index = calloc(1, sizeof(StudentIndex));
+    if (index == NULL) {
+        return -1;
+    }
+    index->slotCount = 64;
+    index->slots = malloc(index->slotCount * sizeof(int));
+    if (index->slots == NULL) {
+        free(index);
+        return -1;
+    }
+    for (int i = 0; i < index->slotCount; i++) {
+        index->slots[i] = -1;
+    }
+    roster->index = index;
+    return 0;
+}
+
+int rosterEnableDedup(Roster *roster, int mode) {
+    roster->dedupMode = mode;
+    if (mode == DEDUP_NONE) {
+        return 0;
+    }
+    roster->dedupSlotCount = 64;
+    roster->dedupSlots = malloc(roster->dedupSlotCount * sizeof(int));
+    if (roster->dedupSlots == NULL) {
+        roster->dedupMode = DEDUP_NONE;
+        return -1;
+    }
+    for (int i = 0; i < roster->dedupSlotCount; i++) {
+        roster->dedupSlots[i] = -1;
+    }
+    return 0;
+}
+
+static unsigned int hashStudentKey(const Student *student) {
+    unsigned int hash = hashName(student->lastName, student->firstName);
+    return (hash ^ (unsigned int)dateKey(student->year, student->month, student->day)) * 16777619u;
+}
+
+static int sameStudentKey(const Student *a, const Student *b) {
+    return a->year == b->year && a->month == b->month && a->day == b->day &&
+           strcmp(a->lastName, b->lastName) == 0 && strcmp(a->firstName, b->firstName) == 0;
+}
+
+// Slot holding the record with the same key as student, or the empty slot where it belongs
+static int *dedupFindSlot(const Roster *roster, int *slots, int slotCount, const Student *student) {
+    unsigned int mask = (unsigned int)slotCount - 1;
+    unsigned int pos = hashStudentKey(student) & mask;
+    while (slots[pos] != -1 && !sameStudentKey(&roster->students[slots[pos]], student)) {
+        pos = (pos + 1) & mask;
+    }
+    return &slots[pos];
+}
+
+static int dedupGrow(Roster *roster) {
+    int newCount = roster->dedupSlotCount * 2;
+    int *newSlots = malloc(newCount * sizeof(int));
+    if (newSlots == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < newCount; i++) {
+        newSlots[i] = -1;
+    }
+    for (int i = 0; i < roster->dedupSlotCount; i++) {
+        int entry = roster->dedupSlots[i];
+        if (entry != -1) {
+            *dedupFindSlot(roster, newSlots, newCount, &roster->students[entry]) = entry;
+        }
+    }
+    free(roster->dedupSlots);
+    roster->dedupSlots = newSlots;
+    roster->dedupSlotCount = newCount;
+    return 0;
+}
+
+void rosterFree(Roster *roster) {
+    if (roster->index != NULL) {
+        free(roster->index->slots);
+        rosterLargeFree(roster->allocator, roster->index->byDate);
+        free(roster->index);
+    }
+    free(roster->dedupSlots);
+    rosterLargeFree(roster->allocator, roster->students);
+    memset(roster, 0, sizeof(*roster));
+}
+
+// Append a parsed student, growing the array as needed
+int rosterAdd(Roster *roster, const Student *student) {
+    int *dedupSlot = NULL;
+
+    if (roster->dedupMode != DEDUP_NONE) {
+        if ((roster->dedupUsed + 1) * 2 > roster->dedupSlotCount && dedupGrow(roster) != 0) {
+            return -1;
+        }
+        dedupSlot = dedupFindSlot(roster, roster->dedupSlots, roster->dedupSlotCount, student);
+        if (*dedupSlot != -1) {
+            Student *kept = &roster->students[*dedupSlot];
+            if (roster->dedupMode == DEDUP_FIRST ||
+                (roster->dedupMode == DEDUP_BEST_GPA && student->gpa <= kept->gpa)) {
+                return 0;
+            }
+            // Overwrite in place, whatever the status: the name and date keys don't change
+            *kept = *student;
+            return 0;
+        }
+    }
+    if (roster->count == roster->capacity) {
+        int newCapacity = roster->capacity * 2;
+        size_t oldBytes = (size_t)roster->capacity * sizeof(Student);
+        Student *grown = rosterLargeRealloc(roster->allocator, roster->students, oldBytes,
+                                            (size_t)newCapacity * sizeof(Student));
+        if (grown == NULL) {
+            return -1;
+        }
+        roster->students = grown;
+        roster->capacity = newCapacity;
+    }
+    int entry = roster->count;
+    roster->students[entry] = *student;
+
+    if (roster->index != NULL && indexAddStudent(roster, entry) != 0) {
+        return -1;
+    }
+    roster->count++;
+    if (dedupSlot != NULL) {
+        *dedupSlot = entry;
+        roster->dedupUsed++;
+    }
+    return 0;
+}
+
+// Keep only the students the output option includes. For the plain sorted output, before
+// sorting: the index and duplicate hashes are not updated.
+void rosterSelect(Roster *roster, int option) {
+    if (option == 3) {
+        return;
+    }
+    int kept = 0;
+    for (int i = 0; i < roster->count; i++) {
+        if (rosterOptionIncludes(option, &roster->students[i])) {
+            roster->students[kept++] = roster->students[i];
+        }
+    }
+    roster->count = kept;
+}
+
+// Index a roster that was loaded (and possibly sorted) without one
+int rosterBuildIndex(Roster *roster) {
+    if (rosterEnableIndex(roster) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < roster->count; i++) {
+        if (indexAddStudent(roster, i) != 0) {
+            return -1;
+        }
+    }
+    return rosterIndexBuildDateOrder(roster);
+}
+
+// Returns 0, or -1 if the buffer is out of memory
+static int bufferReserve(OutputBuffer *buffer, size_t extra) {
+    if (buffer->failed) {
+        return -1;
+    }
+    if (buffer->length + extra <= buffer->capacity) {
+        return 0;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : OUTPUT_FLUSH_SIZE * 2;
+    while (capacity < buffer->length + extra) capacity *= 2;
+    char *grown = realloc(buffer->data, capacity);
+    if (grown == NULL) {
+        buffer->failed = 1;
+        return -1;
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+void rosterAppendBytes(OutputBuffer *buffer, const void *bytes, size_t length) {
+    if (bufferReserve(buffer, length) != 0) return;
+    memcpy(buffer->data + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+static void appendString(OutputBuffer *buffer, const char *text) {
+    rosterAppendBytes(buffer, text, strlen(text));
+}
+
+void rosterAppendChar(OutputBuffer *buffer, char c) {
+    if (bufferReserve(buffer, 1) != 0) return;
+    buffer->data[buffer->length++] = c;
+}
+
+static void appendInt(OutputBuffer *buffer, long long value) {
+    char digits[24];
+    int count = 0;
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    do {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (bufferReserve(buffer, count + 1) != 0) return;
+    if (value < 0) buffer->data[buffer->length++] = '-';
+    while (count > 0) buffer->data[buffer->length++] = digits[--count];
+}
+
+// Same digits as printf("%.3f"). A float times 1000 is exact in a double, so ties are real ties
+// and are rounded to even like glibc does.
+static void appendFixed3(OutputBuffer *buffer, float value) {
+    if (!isfinite(value)) {
+        char text[16];
+        snprintf(text, sizeof(text), "%.3f", value);
+        appendString(buffer, text);
+        return;
+    }
+    long long thousandths = roundThousandths(value);
+    if (signbit(value)) rosterAppendChar(buffer, '-');
+    appendInt(buffer, thousandths / 1000);
+    rosterAppendChar(buffer, '.');
+    rosterAppendChar(buffer, (char)('0' + thousandths / 100 % 10));
+    rosterAppendChar(buffer, (char)('0' + thousandths / 10 % 10));
+    rosterAppendChar(buffer, (char)('0' + thousandths % 10));
+}
+
+static void appendIsoDate(OutputBuffer *buffer, int year, int month, int day) {
+    appendInt(buffer, year);
+    rosterAppendChar(buffer, '-');
+    rosterAppendChar(buffer, (char)('0' + month / 10));
+    rosterAppendChar(buffer, (char)('0' + month % 10));
+    rosterAppendChar(buffer, '-');
+    rosterAppendChar(buffer, (char)('0' + day / 10));
+    rosterAppendChar(buffer, (char)('0' + day % 10));
+}
+
+static void appendJsonString(OutputBuffer *buffer, const char *text) {
+    rosterAppendChar(buffer, '"');
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            rosterAppendChar(buffer, '\\');
+            rosterAppendChar(buffer, (char)*p);
+        } else if (*p < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", *p);
+            appendString(buffer, escaped);
+        } else {
+            rosterAppendChar(buffer, (char)*p);
+        }
+    }
+    rosterAppendChar(buffer, '"');
+}
+
+void rosterAppendLittleEndian(OutputBuffer *buffer, unsigned long long value, int bytes) {
+    if (bufferReserve(buffer, bytes) != 0) return;
+    for (int i = 0; i < bytes; i++) {
+        buffer->data[buffer->length++] = (char)((value >> (8 * i)) & 0xFF);
+    }
+}
+
+// Without a file the formatted bytes stay in the buffer for the caller to take.
+// Returns -1 if the writer ran out of memory; nothing more is written then.
+int rosterRecordWriterFlush(RecordWriter *writer) {
+    if (writer->buffer.failed || writer->pool.failed) {
+        return -1;
+    }
+    if (writer->file != NULL && writer->buffer.length > 0) {
+        fwrite(writer->buffer.data, 1, writer->buffer.length, writer->file);
+        writer->buffer.length = 0;
+    }
+    return 0;
+}
+
+void rosterRecordWriterInit(RecordWriter *writer, FILE *file, int format) {
+    memset(writer, 0, sizeof(*writer));
+    writer->file = file;
+    writer->format = format;
+    if (format == FORMAT_CSV) {
+        appendString(&writer->buffer, "firstName,lastName,gpa,birthDate,status,toefl\n");
+    } else if (format == FORMAT_BINARY) {
+        rosterAppendBytes(&writer->buffer, BINARY_MAGIC, 8);
+        rosterAppendLittleEndian(&writer->buffer, BINARY_RECORD_SIZE, 4);
+        rosterAppendLittleEndian(&writer->buffer, 0, 4);
+    }
+}
+
+// A writer for records in the middle of the output: no file and no header. In the binary format
+// the names are numbered from poolBase, the pool bytes of the records before this slice.
+void rosterRecordWriterInitSlice(RecordWriter *writer, int format, unsigned long long poolBase) {
+    memset(writer, 0, sizeof(*writer));
+    writer->format = format;
+    writer->poolBase = poolBase;
+}
+
+// Serialize one student; 'I' records carry the TOEFL field
+void rosterRecordWriterAdd(RecordWriter *writer, const Student *student) {
+    OutputBuffer *buffer = &writer->buffer;
+    int hasToefl = student->status == 'I';
+    int toefl = hasToefl ? student->toefl : 0;
+
+    switch (writer->format) {
+        case FORMAT_TEXT:
+            appendString(buffer, student->firstName);
+            rosterAppendChar(buffer, ' ');
+            appendString(buffer, student->lastName);
+            rosterAppendChar(buffer, ' ');
+            appendFixed3(buffer, student->gpa);
+            rosterAppendChar(buffer, ' ');
+            appendString(buffer, rosterMonthAbbreviation(student->month));
+            rosterAppendChar(buffer, '-');
+            appendInt(buffer, student->day);
+            rosterAppendChar(buffer, '-');
+            appendInt(buffer, student->year);
+            rosterAppendChar(buffer, ' ');
+            rosterAppendChar(buffer, student->status);
+            if (hasToefl) {
+                rosterAppendChar(buffer, ' ');
+                appendInt(buffer, toefl);
+            }
+            rosterAppendChar(buffer, '\n');
+            break;
+        case FORMAT_CSV:
+            appendString(buffer, student->firstName);
+            rosterAppendChar(buffer, ',');
+            appendString(buffer, student->lastName);
+            rosterAppendChar(buffer, ',');
+            appendFixed3(buffer, student->gpa);
+            rosterAppendChar(buffer, ',');
+            appendIsoDate(buffer, student->year, student->month, student->day);
+            rosterAppendChar(buffer, ',');
+            rosterAppendChar(buffer, student->status);
+            rosterAppendChar(buffer, ',');
+            if (hasToefl) appendInt(buffer, toefl);
+            rosterAppendChar(buffer, '\n');
+            break;
+        case FORMAT_JSONL:
+            appendString(buffer, "{\"firstName\":");
+            appendJsonString(buffer, student->firstName);
+            appendString(buffer, ",\"lastName\":");
+            appendJsonString(buffer, student->lastName);
+            appendString(buffer, ",\"gpa\":");
+            appendFixed3(buffer, student->gpa);
+            appendString(buffer, ",\"birthDate\":\"");
+            appendIsoDate(buffer, student->year, student->month, student->day);
+            appendString(buffer, "\",\"status\":\"");
+            rosterAppendChar(buffer, student->status);
+            rosterAppendChar(buffer, '"');
+            if (hasToefl) {
+                appendString(buffer, ",\"toefl\":");
+                appendInt(buffer, toefl);
+            }
+            appendString(buffer, "}\n");
+            break;
+        case FORMAT_BINARY: {
+            union { float f; unsigned int u; } gpaBits;
+            gpaBits.f = student->gpa;
+            rosterAppendLittleEndian(buffer, writer->poolBase + writer->pool.length, 4);
+            rosterAppendBytes(&writer->pool, student->firstName, strlen(student->firstName) + 1);
+            rosterAppendLittleEndian(buffer, writer->poolBase + writer->pool.length, 4);
+            rosterAppendBytes(&writer->pool, student->lastName, strlen(student->lastName) + 1);
+            rosterAppendLittleEndian(buffer, (unsigned)student->year, 2);
+            rosterAppendLittleEndian(buffer, (unsigned)student->month, 1);
+            rosterAppendLittleEndian(buffer, (unsigned)student->day, 1);
+            rosterAppendLittleEndian(buffer, gpaBits.u, 4);
+            rosterAppendLittleEndian(buffer, (unsigned char)student->status, 1);
+            rosterAppendLittleEndian(buffer, 0, 3);
+            rosterAppendLittleEndian(buffer, (unsigned int)toefl, 4);
+            break;
+        }
+    }
+    writer->recordCount++;
+
+    if (buffer->length >= OUTPUT_FLUSH_SIZE) {
+        rosterRecordWriterFlush(writer);
+    }
+}
+
+// Append whatever the format needs after the last record
+static void recordWriterEnd(RecordWriter *writer) {
+    if (writer->format == FORMAT_BINARY) {
+        rosterRecordWriterFlush(writer);
+        rosterAppendBytes(&writer->buffer, writer->pool.data, writer->pool.length);
+        rosterAppendLittleEndian(&writer->buffer, writer->recordCount, 8);
+        rosterAppendLittleEndian(&writer->buffer, writer->pool.length, 8);
+    }
+}
+
+// Write whatever the format needs after the last record and release the buffers
+int rosterRecordWriterFinish(RecordWriter *writer) {
+    recordWriterEnd(writer);
+    int status = rosterRecordWriterFlush(writer);
+    free(writer->buffer.data);
+    free(writer->pool.data);
+    memset(&writer->buffer, 0, sizeof(writer->buffer));
+    memset(&writer->pool, 0, sizeof(writer->pool));
+    return status;
+}
+
+static int nameMatches(const Student *s, int option, const char *lastName, const char *firstName, int year) {
+    return strcmp(s->lastName, lastName) == 0 && strcmp(s->firstName, firstName) == 0 &&
+           rosterOptionIncludes(option, s) && (year == 0 || s->year == year);
+}
+
+// Gather the students named firstName lastName (born in year, unless 0) from the name index into *matches,
+// in sorted order. The probe chain is walked twice, so only the matches are copied.
+// Returns how many were found, or -1 if out of memory.
+int rosterIndexFindName(const Roster *roster, int option, const char *lastName, const char *firstName, int year,
+                  Student **matches) {
+    const StudentIndex *index = roster->index;
+    unsigned int mask = (unsigned int)index->slotCount - 1;
+    unsigned int start = hashName(lastName, firstName) & mask;
+    int found = 0;
+    for (unsigned int pos = start; index->slots[pos] != -1; pos = (pos + 1) & mask) {
+        found += nameMatches(&roster->students[index->slots[pos]], option, lastName, firstName, year);
+    }
+
+    *matches = malloc((found + 1) * sizeof(Student));
+    if (*matches == NULL) {
+        return -1;
+    }
+    found = 0;
+    for (unsigned int pos = start; index->slots[pos] != -1; pos = (pos + 1) & mask) {
+        const Student *s = &roster->students[index->slots[pos]];
+        if (nameMatches(s, option, lastName, firstName, year)) {
+            (*matches)[found++] = *s;
+        }
+    }
+    if (rosterSortStudents(*matches, found, NULL, roster->allocator) != 0) {
+        free(*matches);
+        *matches = NULL;
+        return -1;
+    }
+    return found;
+}
+
+// Look up every student with the given name; matches are written sorted, domestic first.
+// Returns 0, or -1 if out of memory.
+int rosterQueryByName(const Roster *roster, RecordWriter *output, int option, const char *lastName,
+                      const char *firstName) {
+    Student *matches;
+    int matchCount = rosterIndexFindName(roster, option, lastName, firstName, 0, &matches);
+    if (matchCount < 0) {
+        return -1;
+    }
+    for (int i = 0; i < matchCount; i++) {
+        rosterRecordWriterAdd(output, &matches[i]);
+    }
+    free(matches);
+    return 0;
+}
+
+// First position in a date-ordered index whose key is >= key
+static int lowerBoundDate(const DateIndexEntry *entries, int count, int key) {
+    int low = 0, high = count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (entries[mid].dateKey < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Write every student born between fromKey and toKey (inclusive) in the normal sorted order.
+// Returns 0, or -1 if out of memory.
+int rosterQueryByDateRange(const Roster *roster, RecordWriter *output, int option, int fromKey, int toKey) {
+    const StudentIndex *index = roster->index;
+    int first = lowerBoundDate(index->byDate, roster->count, fromKey);
+    int last = lowerBoundDate(index->byDate, roster->count, toKey + 1);
+    Student *matches = malloc((last - first + 1) * sizeof(Student));
+    int matchCount = 0;
+    if (matches == NULL) {
+        return -1;
+    }
+
+    for (int i = first; i < last; i++) {
+        const Student *s = &roster->students[index->byDate[i].index];
+        if (rosterOptionIncludes(option, s)) {
+            matches[matchCount++] = *s;
+        }
+    }
+    int status = rosterSortStudents(matches, matchCount, NULL, roster->allocator);
+    for (int i = 0; i < matchCount && status == 0; i++) {
+        rosterRecordWriterAdd(output, &matches[i]);
+    }
+    free(matches);
+    return status;
+}
+
+// Parse a birth date in the input format (e.g. Feb-2-1990) into a date key, -1 if invalid
+int rosterParseDateKey(const char *text) {
+    int day = 0, month = 0, year = 0;
+    rosterDivideBirthDigits(text, &day, &month, &year);
+    if (month == -1 || day < 1 || day > 31) {
+        return -1;
+    }
+    return dateKey(year, month, day);
+}
+
+// --sort-by: the key plan is encoded once per record into a fixed-width byte string whose memcmp
+// order is the requested order, so sorting costs the same whatever keys were asked for
+typedef struct {
+    const unsigned char *keys;
+    int width;
+} EncodedKeys;
+
+static inline int compareEncodedKeys(void *context, const int *a, const int *b) {
+    const EncodedKeys *encoded = context;
+    return memcmp(encoded->keys + (size_t)*a * encoded->width, encoded->keys + (size_t)*b * encoded->width,
+                  encoded->width);
+}
+
+static int sortEncodedKeys(int *array, size_t count, void *context, const LargeAllocator *allocator);
+DEFINE_TIM_SORT(sortEncodedKeys, int, compareEncodedKeys)
+
+static int sortKeyWidth(int field) {
+    switch (field) {
+        case SORT_KEY_DATE: return 4;
+        case SORT_KEY_YEAR: return 2;
+        case SORT_KEY_LAST:
+        case SORT_KEY_FIRST: return SORT_KEY_NAME_WIDTH;
+        case SORT_KEY_GPA: return 2;
+        case SORT_KEY_TOEFL: return 4;
+    }
+    return 0;
+}
+
+// Parse "gpa:desc,last:asc,..." into plan; returns 0 if the spec is invalid
+int rosterParseSortPlan(const char *spec, SortPlan *plan) {
+    const char *names[] = {"date", "year", "last", "first", "gpa", "toefl"};
+    memset(plan, 0, sizeof(*plan));
+
+    while (*spec) {
+        size_t length = strcspn(spec, ",");
+        size_t nameLength = strcspn(spec, ":,");
+        SortKey key = {-1, 0};
+
+        for (int field = 0; field < (int)(sizeof(names) / sizeof(names[0])); field++) {
+            if (strlen(names[field]) == nameLength && strncmp(spec, names[field], nameLength) == 0) {
+                key.field = field;
+            }
+        }
+        if (nameLength < length) {
+            const char *direction = spec + nameLength + 1;
+            size_t directionLength = length - nameLength - 1;
+            if (directionLength == 4 && strncmp(direction, "desc", 4) == 0) {
+                key.descending = 1;
+            } else if (directionLength != 3 || strncmp(direction, "asc", 3) != 0) {
+                return 0;
+            }
+        }
+        if (key.field == -1 || plan->keyCount == SORT_PLAN_MAX_KEYS) {
+            return 0;
+        }
+        plan->keys[plan->keyCount++] = key;
+        plan->width += sortKeyWidth(key.field);
+
+        spec += length;
+        if (*spec == ',') spec++;
+    }
+    return plan->keyCount > 0;
+}
+
+static void putBigEndian(unsigned char *out, unsigned int value, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--) {
+        out[i] = (unsigned char)(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+// Encode student's key behind its status byte, so domestic records still come first;
+// descending fields are stored bit-inverted
+static void encodeSortKey(const SortPlan *plan, const Student *student, unsigned char *out) {
+    *out++ = (unsigned char)student->status;
+    for (int k = 0; k < plan->keyCount; k++) {
+        int width = sortKeyWidth(plan->keys[k].field);
+        switch (plan->keys[k].field) {
+            case SORT_KEY_DATE:
+                putBigEndian(out, (unsigned)dateKey(student->year, student->month, student->day), 4);
+                break;
+            case SORT_KEY_YEAR:
+                putBigEndian(out, (unsigned)student->year, 2);
+                break;
+            case SORT_KEY_LAST:
+                memset(out, 0, width);
+                memcpy(out, student->lastName, strnlen(student->lastName, width));
+                break;
+            case SORT_KEY_FIRST:
+                memset(out, 0, width);
+                memcpy(out, student->firstName, strnlen(student->firstName, width));
+                break;
+            case SORT_KEY_GPA:
+                // At the printed precision, so the key orders exactly what the report shows
+                putBigEndian(out, isnan(student->gpa) ? 0u : (unsigned)rosterGpaBucket(student->gpa), 2);
+                break;
+            case SORT_KEY_TOEFL: {
+                // Domestic students have no score and sort below every international one
+                unsigned int toefl = student->status == 'I' ? (unsigned int)student->toefl ^ 0x80000000u : 0u;
+                putBigEndian(out, toefl, 4);
+                break;
+            }
+        }
+        if (plan->keys[k].descending) {
+            for (int i = 0; i < width; i++) out[i] = (unsigned char)~out[i];
+        }
+        out += width;
+    }
+}
+
+// Plans of "gpa" or "year,gpa" (either direction) have few distinct keys: the status byte, the birth
+// year and the GPA at the printed precision. They are sorted by a stable counting sort in two linear
+// passes instead of comparing encoded keys. Returns 0 if the plan doesn't fit, if the buckets would
+// outnumber the records so much that comparing is cheaper, or if there is no memory for the buckets.
+#define COUNTING_SORT_MAX_BUCKETS (1 << 22)
+
+static int countingSortKey(const SortPlan *plan, const Student *student, int firstYear, int yearSpan) {
+    int key = student->status == 'I';
+    for (int k = 0; k < plan->keyCount; k++) {
+        int value, range;
+        if (plan->keys[k].field == SORT_KEY_YEAR) {
+            value = student->year - firstYear;
+            range = yearSpan;
+        } else {
+            value = isnan(student->gpa) ? 0 : rosterGpaBucket(student->gpa);
+            range = GPA_BUCKETS;
+        }
+        key = key * range + (plan->keys[k].descending ? range - 1 - value : value);
+    }
+    return key;
+}
+
+static int countingSortByPlan(Student *students, int count, const SortPlan *plan, const LargeAllocator *allocator) {
+    int hasYear = plan->keyCount == 2 && plan->keys[0].field == SORT_KEY_YEAR;
+    if (plan->keys[plan->keyCount - 1].field != SORT_KEY_GPA || (plan->keyCount == 2 && !hasYear) ||
+        plan->keyCount > 2) {
+        return 0;
+    }
+    int firstYear = students[0].year, lastYear = students[0].year;
+    for (int i = 1; i < count && hasYear; i++) {
+        if (students[i].year < firstYear) firstYear = students[i].year;
+        if (students[i].year > lastYear) lastYear = students[i].year;
+    }
+    int yearSpan = lastYear - firstYear + 1;
+    long long bucketCount = 2LL * GPA_BUCKETS * (hasYear ? yearSpan : 1);
+    if (bucketCount > COUNTING_SORT_MAX_BUCKETS || bucketCount > 16LL * count + 65536) {
+        return 0;
+    }
+
+    int *next = calloc((size_t)bucketCount + 1, sizeof(int));
+    Student *sorted = rosterLargeAlloc(allocator, (size_t)count * sizeof(Student));
+    if (next == NULL || sorted == NULL) {
+        free(next);
+        rosterLargeFree(allocator, sorted);
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        next[countingSortKey(plan, &students[i], firstYear, yearSpan) + 1]++;
+    }
+    for (long long b = 0; b < bucketCount; b++) {
+        next[b + 1] += next[b];
+    }
+    for (int i = 0; i < count; i++) {
+        sorted[next[countingSortKey(plan, &students[i], firstYear, yearSpan)]++] = students[i];
+    }
+    memcpy(students, sorted, (size_t)count * sizeof(Student));
+
+    free(next);
+    rosterLargeFree(allocator, sorted);
+    return 1;
+}
+
+// Stable sort of count students by plan; returns 0, or -1 if out of memory
+int rosterSortStudentsByPlan(Student *students, int count, const SortPlan *plan, const LargeAllocator *allocator) {
+    if (count < 2 || countingSortByPlan(students, count, plan, allocator)) {
+        return 0;
+    }
+    size_t width = plan->width + 1;
+    unsigned char *keys = rosterLargeAlloc(allocator, (size_t)count * width);
+    int *order = rosterLargeAlloc(allocator, count * sizeof(int));
+    Student *sorted = rosterLargeAlloc(allocator, (size_t)count * sizeof(Student));
+    int status = keys != NULL && order != NULL && sorted != NULL ? 0 : -1;
+
+    for (int i = 0; i < count && status == 0; i++) {
+        encodeSortKey(plan, &students[i], keys + (size_t)i * width);
+        order[i] = i;
+    }
+    EncodedKeys encoded = {keys, (int)width};
+    if (status == 0) {
+        status = sortEncodedKeys(order, count, &encoded, allocator);
+    }
+    if (status == 0) {
+        for (int i = 0; i < count; i++) {
+            sorted[i] = students[order[i]];
+        }
+        memcpy(students, sorted, (size_t)count * sizeof(Student));
+    }
+
+    rosterLargeFree(allocator, keys);
+    rosterLargeFree(allocator, order);
+    rosterLargeFree(allocator, sorted);
+    return status;
+}
+
+void rosterWrite(RecordWriter *output, const Roster *roster, int option) {
+    for (int i = 0; i < roster->count; i++) {
+        if (rosterOptionIncludes(option, &roster->students[i])) {
+            rosterRecordWriterAdd(output, &roster->students[i]);
+        }
+    }
+}
+
+// Public API (roster.h)
+#define FILTER_LOOKUP 0
+#define FILTER_RANGE 1
+
+typedef struct {
+    int kind;                 // FILTER_*
+    char lastName[50], firstName[50];
+    int fromKey, toKey;
+} RosterFilter;
+
+struct RosterContext {
+    LargeAllocator allocator;  // the roster's large buffers
+    Roster roster;
+    int option;
+    int format;
+    SortPlan sortPlan;
+    size_t maxLineLength;
+    RosterFilter *filters;
+    int filterCount, filterCapacity;
+    RosterErrorHandler errorHandler;
+    void *errorUser;
+    OutputBuffer errors;      // rejected-line messages when there is no handler
+    int started;              // input has arrived, so the dedup mode is fixed
+    int sorted;
+    OutputBuffer pending;     // rosterContextFeed: the line still waiting for its newline
+    int pendingOversized;     // ... which is already longer than maxLineLength
+    OutputBuffer line;        // NUL-terminated copy of the line being parsed
+    RecordWriter writer;      // rosterContextSerialize
+    int serializing;
+    int nextRecord;           // count means the trailer is next, count + 1 that everything is formatted
+    size_t served;            // bytes of writer.buffer already returned
+};
+
+RosterContext *rosterContextCreate(void) {
+    RosterContext *context = calloc(1, sizeof(RosterContext));
+    if (context == NULL) {
+        return NULL;
+    }
+    if (rosterInit(&context->roster, &context->allocator) != 0) {
+        free(context);
+        return NULL;
+    }
+    context->option = 3;
+    context->format = FORMAT_TEXT;
+    context->maxLineLength = DEFAULT_MAX_LINE_LENGTH;
+    return context;
+}
+
+void rosterContextDestroy(RosterContext *context) {
+    if (context == NULL) {
+        return;
+    }
+    rosterFree(&context->roster);
+    free(context->filters);
+    free(context->errors.data);
+    free(context->pending.data);
+    free(context->line.data);
+    free(context->writer.buffer.data);
+    free(context->writer.pool.data);
+    free(context);
+}
+
+int rosterContextSetOption(RosterContext *context, int option) {
+    if (context->sorted || option < 1 || option > 3) {
+        return -1;
+    }
+    context->option = option;
+    return 0;
+}
+
+int rosterContextSetFormat(RosterContext *context, int format) {
+    if (context->serializing || format < FORMAT_TEXT || format > FORMAT_BINARY) {
+        return -1;
+    }
+    context->format = format;
+    return 0;
+}
+
+int rosterContextSetDedup(RosterContext *context, int mode) {
+    if (context->started || mode < DEDUP_NONE || mode > DEDUP_BEST_GPA) {
+        return -1;
+    }
+    free(context->roster.dedupSlots);
+    context->roster.dedupSlots = NULL;
+    return rosterEnableDedup(&context->roster, mode);
+}
+
+int rosterContextSetAllocator(RosterContext *context, void *(*allocate)(size_t bytes), void (*release)(void *buffer)) {
+    if (context->started || (allocate == NULL) != (release == NULL)) {
+        return -1;
+    }
+    // The empty roster was allocated with the previous allocator: start it again with the new one,
+    // keeping the old one if that fails
+    LargeAllocator previous = context->allocator, wanted = {allocate, release};
+    Roster roster;
+    if (rosterInit(&roster, &wanted) != 0 || rosterEnableDedup(&roster, context->roster.dedupMode) != 0) {
+        rosterFree(&roster);
+        return -1;
+    }
+    context->roster.allocator = &previous;
+    rosterFree(&context->roster);
+    context->allocator = wanted;
+    roster.allocator = &context->allocator;
+    context->roster = roster;
+    return 0;
+}
+
+int rosterContextSetSortBy(RosterContext *context, const char *spec) {
+    SortPlan plan;
+    if (context->sorted || !rosterParseSortPlan(spec, &plan)) {
+        return -1;
+    }
+    context->sortPlan = plan;
+    return 0;
+}
+
+int rosterContextSetMaxLineLength(RosterContext *context, size_t maxLineLength) {
+    if (context->sorted || maxLineLength < 1) {
+        return -1;
+    }
+    context->maxLineLength = maxLineLength;
+    return 0;
+}
+
+int rosterContextAddFilter(RosterContext *context, const char *filter) {
+    RosterFilter parsed;
+    memset(&parsed, 0, sizeof(parsed));
+    if (context->sorted) {
+        return -1;
+    }
+    if (strncmp(filter, "lookup=", 7) == 0) {
+        parsed.kind = FILTER_LOOKUP;
+        if (sscanf(filter + 7, "%49[^,],%49s", parsed.lastName, parsed.firstName) != 2) {
+            return -1;
+        }
+    } else if (strncmp(filter, "range=", 6) == 0) {
+        char fromText[50], toText[50];
+        parsed.kind = FILTER_RANGE;
+        if (sscanf(filter + 6, "%49[^,],%49s", fromText, toText) != 2) {
+            return -1;
+        }
+        parsed.fromKey = rosterParseDateKey(fromText);
+        parsed.toKey = rosterParseDateKey(toText);
+        if (parsed.fromKey == -1 || parsed.toKey == -1) {
+            return -1;
+        }
+    } else {
+        return -1;
+    }
+
+    if (context->filterCount == context->filterCapacity) {
+        int capacity = context->filterCapacity ? context->filterCapacity * 2 : 4;
+        RosterFilter *grown = realloc(context->filters, capacity * sizeof(RosterFilter));
+        if (grown == NULL) {
+            return -1;
+        }
+        context->filters = grown;
+        context->filterCapacity = capacity;
+    }
+    context->filters[context->filterCount++] = parsed;
+    return 0;
+}
+
+void rosterContextSetErrorHandler(RosterContext *context, RosterErrorHandler handler, void *user) {
+    context->errorHandler = handler;
+    context->errorUser = user;
+}
+
+// Returns 0, or -1 if the message could not be collected for lack of memory
+static int rosterContextReject(RosterContext *context, const char *detail, const char *message) {
+    if (context->errorHandler == NULL) {
+        rosterAppendBytes(&context->errors, message, strlen(message));
+        return context->errors.failed ? -1 : 0;
+    }
+    if (detail[0] != '\0') {
+        context->errorHandler(context->errorUser, detail, 1);
+    }
+    context->errorHandler(context->errorUser, message, 0);
+    return 0;
+}
+
+// Parse one complete line of at most maxLineLength bytes; returns 0, or -1 if out of memory
+static int rosterContextTakeLine(RosterContext *context, const char *text, size_t length) {
+    char message[128], detail[256];
+    Student student;
+
+    context->line.length = 0;
+    rosterAppendBytes(&context->line, text, length);
+    rosterAppendChar(&context->line, '\0');
+    if (context->line.failed) {
+        return -1;
+    }
+    if (rosterParseStudentRecord(context->line.data, &student, message, sizeof(message), detail, sizeof(detail))) {
+        return rosterAdd(&context->roster, &student);
+    }
+    return rosterContextReject(context, detail, message);
+}
+
+static int rosterContextRejectLong(RosterContext *context) {
+    char message[128];
+    snprintf(message, sizeof(message), "Error: Line too long - exceeds %zu bytes\n", context->maxLineLength);
+    return rosterContextReject(context, "", message);
+}
+
+int rosterContextAddLine(RosterContext *context, const char *line, size_t length) {
+    if (context->sorted) {
+        return -1;
+    }
+    context->started = 1;
+    if (length > context->maxLineLength) {
+        return rosterContextRejectLong(context);
+    }
+    return rosterContextTakeLine(context, line, length);
+}
+
+int rosterContextFeed(RosterContext *context, const char *data, size_t length) {
+    OutputBuffer *pending = &context->pending;
+
+    if (context->sorted) {
+        return -1;
+    }
+    context->started = 1;
+    while (length > 0) {
+        const char *newline = memchr(data, '\n', length);
+        size_t take = newline != NULL ? (size_t)(newline - data) : length;
+
+        // An overlong line is dropped as it arrives instead of being buffered whole
+        if (!context->pendingOversized && pending->length + take > context->maxLineLength) {
+            context->pendingOversized = 1;
+            pending->length = 0;
+        }
+        if (newline == NULL) {
+            if (!context->pendingOversized) {
+                rosterAppendBytes(pending, data, take);
+            }
+            break;
+        }
+
+        int status;
+        if (context->pendingOversized) {
+            status = rosterContextRejectLong(context);
+        } else if (pending->length == 0) {
+            status = rosterContextTakeLine(context, data, take);
+        } else {
+            rosterAppendBytes(pending, data, take);
+            status = pending->failed ? -1 : rosterContextTakeLine(context, pending->data, pending->length);
+        }
+        if (status != 0) {
+            return -1;
+        }
+        pending->length = 0;
+        context->pendingOversized = 0;
+        data += take + 1;
+        length -= take + 1;
+    }
+    return pending->failed ? -1 : 0;
+}
+
+static int rosterFilterMatches(const RosterFilter *filter, const Student *student) {
+    if (filter->kind == FILTER_LOOKUP) {
+        return strcmp(student->lastName, filter->lastName) == 0 && strcmp(student->firstName, filter->firstName) == 0;
+    }
+    int key = dateKey(student->year, student->month, student->day);
+    return key >= filter->fromKey && key <= filter->toKey;
+}
+
+int rosterContextSort(RosterContext *context) {
+    Roster *roster = &context->roster;
+
+    if (context->sorted) {
+        return roster->count;
+    }
+    // A final line without a newline
+    int status = 0;
+    if (context->pendingOversized) {
+        status = rosterContextRejectLong(context);
+    } else if (context->pending.length > 0) {
+        status = rosterContextTakeLine(context, context->pending.data, context->pending.length);
+    }
+    if (status != 0) {
+        return -1;
+    }
+    context->pending.length = 0;
+    context->pendingOversized = 0;
+
+    rosterSelect(roster, context->option);
+    if (context->filterCount > 0) {
+        int kept = 0;
+        for (int i = 0; i < roster->count; i++) {
+            for (int f = 0; f < context->filterCount; f++) {
+                if (rosterFilterMatches(&context->filters[f], &roster->students[i])) {
+                    roster->students[kept++] = roster->students[i];
+                    break;
+                }
+            }
+        }
+        roster->count = kept;
+    }
+    if (context->sortPlan.keyCount > 0) {
+        status = rosterSortStudentsByPlan(roster->students, roster->count, &context->sortPlan, roster->allocator);
+    } else {
+        status = rosterSortStudents(roster->students, roster->count, NULL, roster->allocator);
+    }
+    if (status != 0) {
+        return -1;
+    }
+    context->sorted = 1;
+    return roster->count;
+}
+
+int rosterContextCount(const RosterContext *context) {
+    return context->sorted ? context->roster.count : 0;
+}
+
+// The sorted records themselves, for the command's own writers
+const Student *rosterContextStudents(const RosterContext *context, int *count) {
+    *count = rosterContextCount(context);
+    return context->roster.students;
+}
+
+int rosterContextGet(const RosterContext *context, int position, RosterRecord *record) {
+    if (!context->sorted || position < 0 || position >= context->roster.count) {
+        return -1;
+    }
+    const Student *student = &context->roster.students[position];
+    record->firstName = student->firstName;
+    record->lastName = student->lastName;
+    record->year = student->year;
+    record->month = student->month;
+    record->day = student->day;
+    record->gpa = student->gpa;
+    record->status = student->status;
+    record->toefl = student->toefl;
+    return 0;
+}
+
+size_t rosterContextSerialize(RosterContext *context, char *buffer, size_t capacity) {
+    RecordWriter *writer = &context->writer;
+    int count = rosterContextSort(context);
+
+    if (count < 0) {
+        return (size_t)-1;
+    }
+    if (!context->serializing) {
+        rosterRecordWriterInit(writer, NULL, context->format);
+        context->serializing = 1;
+    }
+    // Format just enough records to fill the caller's buffer
+    while (writer->buffer.length - context->served < capacity && context->nextRecord <= count) {
+        if (context->nextRecord < count) {
+            rosterRecordWriterAdd(writer, &context->roster.students[context->nextRecord]);
+        } else {
+            recordWriterEnd(writer);
+        }
+        context->nextRecord++;
+    }
+    if (rosterRecordWriterFlush(writer) != 0) {
+        return (size_t)-1;
+    }
+
+    size_t available = writer->buffer.length - context->served;
+    size_t copied = available < capacity ? available : capacity;
+    memcpy(buffer, writer->buffer.data + context->served, copied);
+    context->served += copied;
+    if (context->served == writer->buffer.length) {
+        writer->buffer.length = 0;
+        context->served = 0;
+    }
+    return copied;
+}
+
+const char *rosterContextErrors(const RosterContext *context, size_t *length) {
+    *length = context->errors.length;
+    return context->errors.length > 0 ? context->errors.data : "";
+}
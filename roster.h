@@ -0,0 +1,92 @@
+// libroster: load, filter, sort and serialize student records in memory.
+//
+// Each RosterContext holds everything for one job, so contexts can be used concurrently from
+// different threads (one thread per context). Input is fed as raw bytes in any split, results are
+// read back record by record or serialized into caller buffers; nothing touches files or stdio, and
+// running out of memory is reported by the return values, never by exiting.
+#ifndef ROSTER_H
+#define ROSTER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Record formats, see the README for the layouts
+#define ROSTER_FORMAT_TEXT 0
+#define ROSTER_FORMAT_CSV 1
+#define ROSTER_FORMAT_JSONL 2
+#define ROSTER_FORMAT_BINARY 3
+
+// Duplicate handling while loading (same lastName, firstName and birth date)
+#define ROSTER_DEDUP_NONE 0
+#define ROSTER_DEDUP_FIRST 1     // keep the first record seen
+#define ROSTER_DEDUP_LAST 2      // keep the last record seen
+#define ROSTER_DEDUP_BEST_GPA 3  // keep the record with the highest GPA, first one on ties
+
+// Longest first or last name accepted, in bytes of UTF-8 (16 characters of most CJK text). Records are
+// fixed-size so the sorts can move them directly; a line with a longer name is rejected.
+#define ROSTER_NAME_MAX_BYTES 49
+
+typedef struct RosterContext RosterContext;
+
+// A loaded student; the names stay valid until the context is destroyed
+typedef struct {
+    const char *firstName;
+    const char *lastName;
+    int year, month, day;
+    float gpa;
+    char status;  // 'D' for domestic, 'I' for international
+    int toefl;    // -1 for domestic students
+} RosterRecord;
+
+// Called for every rejected input line, in input order. message is the "Error: ..." line that
+// assignment2 writes to its output; detail lines explain the message that follows them.
+typedef void (*RosterErrorHandler)(void *user, const char *message, int detail);
+
+// A new context with the defaults of assignment2: option 3, text format, no dedup, built-in order.
+// Returns NULL if out of memory.
+RosterContext *rosterContextCreate(void);
+void rosterContextDestroy(RosterContext *context);
+
+// Settings. The dedup mode must be set before the first input; the rest before rosterContextSort.
+// Each returns 0, or -1 for an invalid value, a call that comes too late or no memory.
+int rosterContextSetOption(RosterContext *context, int option);              // 1 domestic, 2 international, 3 both
+int rosterContextSetFormat(RosterContext *context, int format);              // ROSTER_FORMAT_*
+int rosterContextSetDedup(RosterContext *context, int mode);                 // ROSTER_DEDUP_*
+int rosterContextSetSortBy(RosterContext *context, const char *spec);        // same syntax as --sort-by
+int rosterContextSetMaxLineLength(RosterContext *context, size_t maxLineLength);
+// Keep only the records matching "lookup=LastName,FirstName" or "range=Mon-D-YYYY,Mon-D-YYYY";
+// with several filters a record is kept if it matches any of them
+int rosterContextAddFilter(RosterContext *context, const char *filter);
+// Where the context's large buffers (records, index, sort scratch) come from: allocate and release
+// replace malloc and free for them, or NULL for both restores malloc. Set before the first input.
+int rosterContextSetAllocator(RosterContext *context, void *(*allocate)(size_t bytes), void (*release)(void *buffer));
+// Without a handler the messages are collected for rosterContextErrors and detail lines are dropped
+void rosterContextSetErrorHandler(RosterContext *context, RosterErrorHandler handler, void *user);
+
+// Input: bytes in any split (a final line without a newline is taken by rosterContextSort), or
+// whole lines without their newline. Return 0, or -1 after rosterContextSort or if out of memory
+// (the context can then only be destroyed).
+int rosterContextFeed(RosterContext *context, const char *data, size_t length);
+int rosterContextAddLine(RosterContext *context, const char *line, size_t length);
+
+// End of input: apply the option and filters and sort. Returns the record count, or -1 if out of memory.
+int rosterContextSort(RosterContext *context);
+
+// Results, after rosterContextSort
+int rosterContextCount(const RosterContext *context);
+int rosterContextGet(const RosterContext *context, int position, RosterRecord *record);  // 0, or -1 if out of range
+// Copy the next bytes of the serialized records (in the context's format) into buffer.
+// Returns the bytes written, 0 once everything has been returned, or (size_t)-1 if out of memory.
+size_t rosterContextSerialize(RosterContext *context, char *buffer, size_t capacity);
+
+// Collected rejected-line messages, one per line
+const char *rosterContextErrors(const RosterContext *context, size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
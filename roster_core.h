@@ -0,0 +1,543 @@
+// Building blocks shared by libroster (roster.c) and the assignment2 command (a2.c): the record
+// type, the roster container, the sorts and the output serializer. Not part of the public API.
+#ifndef ROSTER_CORE_H
+#define ROSTER_CORE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "roster.h"
+
+#define LINE_BLOCK_SIZE (64 * 1024)   // input is read in blocks of this size
+#define DEFAULT_MAX_LINE_LENGTH (1 << 20)
+#define MAX_STUDENTS 1000
+
+// One record for both kinds of student: status is the tag and toefl is only set for 'I'.
+// The birth date is kept as its parsed fields and formatted when written.
+typedef struct {
+    char firstName[ROSTER_NAME_MAX_BYTES + 1];
+    char lastName[ROSTER_NAME_MAX_BYTES + 1];
+    short year;
+    char month;
+    char status;  // 'D' for domestic, 'I' for international
+    int day;
+    float gpa;
+    int toefl;    // -1 for domestic students
+} Student;
+
+// Duplicate handling and output record formats, the values of the public ROSTER_* constants
+#define DEDUP_NONE ROSTER_DEDUP_NONE
+#define DEDUP_FIRST ROSTER_DEDUP_FIRST
+#define DEDUP_LAST ROSTER_DEDUP_LAST
+#define DEDUP_BEST_GPA ROSTER_DEDUP_BEST_GPA
+
+#define FORMAT_TEXT ROSTER_FORMAT_TEXT
+#define FORMAT_CSV ROSTER_FORMAT_CSV
+#define FORMAT_JSONL ROSTER_FORMAT_JSONL
+#define FORMAT_BINARY ROSTER_FORMAT_BINARY
+
+// Fields a --sort-by key plan can order on
+#define SORT_KEY_DATE 0
+#define SORT_KEY_YEAR 1
+#define SORT_KEY_LAST 2
+#define SORT_KEY_FIRST 3
+#define SORT_KEY_GPA 4
+#define SORT_KEY_TOEFL 5
+#define SORT_KEY_NAME_WIDTH 49
+#define SORT_PLAN_MAX_KEYS 8
+
+typedef struct {
+    int field;       // SORT_KEY_*
+    int descending;
+} SortKey;
+
+typedef struct {
+    SortKey keys[SORT_PLAN_MAX_KEYS];
+    int keyCount;    // 0 means the built-in rosterCompareStudents order
+    int width;       // bytes in one encoded key
+} SortPlan;
+
+// GPA in thousandths, the printed precision; 4301 possible values
+#define GPA_BUCKETS 4301
+int rosterGpaBucket(float gpa);
+
+// Hash index over (lastName, firstName) plus a birth date index, built while the roster is loaded
+typedef struct {
+    int dateKey;
+    int index;
+} DateIndexEntry;
+
+typedef struct {
+    int *slots;        // open addressing over record indexes, -1 when empty
+    int slotCount;     // always a power of two
+    int used;
+    DateIndexEntry *byDate;
+} StudentIndex;
+
+typedef struct {
+    void *(*allocate)(size_t bytes);  // NULL for malloc
+    void (*release)(void *buffer);    // frees what allocate returned
+} LargeAllocator;
+
+// Every loaded student of both statuses in one array
+typedef struct {
+    const LargeAllocator *allocator;  // the students array and the date index; NULL for malloc
+    Student *students;
+    int count, capacity;
+    StudentIndex *index;  // NULL unless rosterEnableIndex was called before loading
+    int dedupMode;
+    int *dedupSlots;      // open addressing over (lastName, firstName, birth date), holding record indexes
+    int dedupSlotCount;
+    int dedupUsed;
+} Roster;
+
+// Output serializer shared by every mode: records are formatted into a buffer that is flushed in large
+// writes, or kept for the caller when the writer has no file
+#define OUTPUT_FLUSH_SIZE (64 * 1024)
+
+// Binary records: 16-byte header, 24-byte little-endian records, string pool, 16-byte trailer
+#define BINARY_MAGIC "ROSTER01"
+#define BINARY_RECORD_SIZE 24
+
+typedef struct {
+    char *data;
+    size_t length, capacity;
+    int failed;       // out of memory: later appends are dropped
+} OutputBuffer;
+
+typedef struct {
+    FILE *file;
+    int format;
+    OutputBuffer buffer;
+    OutputBuffer pool;          // binary format: names, written after the last record
+    unsigned long long poolBase; // binary format: pool offset of pool.data[0], for a slice of the output
+    unsigned long long recordCount;
+} RecordWriter;
+
+// Large buffers: the record arrays, index and sort scratch space, from malloc or from the allocator
+// a roster or sort is given (a RosterContext's is set with rosterContextSetAllocator). assignment2's
+// --huge-pages maps the ones of 2 MiB or more on their own, backed by huge pages where the kernel allows,
+// and leaves them untouched so each page is placed on the NUMA node of the thread that first writes it.
+#define HUGE_PAGES_OFF 0
+#define HUGE_PAGES_TRANSPARENT 1   // madvise(MADV_HUGEPAGE) on a 2 MiB aligned mapping
+#define HUGE_PAGES_EXPLICIT 2      // MAP_HUGETLB from the reserved pool, transparent when it is empty
+
+// Type-specialized adaptive stable sort (TimSort). Natural ascending runs are kept, strictly
+// descending runs are reversed, short runs are extended by binary insertion, and runs are merged
+// with galloping, so already-sorted input costs n - 1 comparisons. Each instantiation moves
+// fixed-size elements and calls an inlinable comparator, compare(context, a, b). Returns 0, or -1 if
+// there is no memory for the merge scratch space (the array is then left unsorted).
+#define TIM_SORT_MIN_GALLOP 7
+#define TIM_SORT_MAX_RUNS 85
+
+#define DEFINE_TIM_SORT(name, type, compare)                                                                         \
+typedef struct {                                                                                                     \
+    type *array;                                                                                                     \
+    type *scratch;                                                                                                   \
+    void *context;                                                                                                   \
+    ptrdiff_t minGallop;                                                                                             \
+    int runCount;                                                                                                    \
+    ptrdiff_t runBase[TIM_SORT_MAX_RUNS];                                                                            \
+    ptrdiff_t runLength[TIM_SORT_MAX_RUNS];                                                                          \
+} name##State;                                                                                                       \
+                                                                                                                     \
+/* Leftmost position for key in the sorted base[0..n), searching outward from hint */                                \
+static ptrdiff_t name##GallopLeft(void *context, const type *key, const type *base, ptrdiff_t n, ptrdiff_t hint) {   \
+    ptrdiff_t lastOffset = 0, offset = 1;                                                                            \
+    if (compare(context, &base[hint], key) < 0) {                                                                    \
+        ptrdiff_t maxOffset = n - hint;                                                                              \
+        while (offset < maxOffset && compare(context, &base[hint + offset], key) < 0) {                              \
+            lastOffset = offset;                                                                                     \
+            offset = (offset << 1) + 1;                                                                              \
+        }                                                                                                            \
+        if (offset > maxOffset) offset = maxOffset;                                                                  \
+        lastOffset += hint;                                                                                          \
+        offset += hint;                                                                                              \
+    } else {                                                                                                         \
+        ptrdiff_t maxOffset = hint + 1;                                                                              \
+        while (offset < maxOffset && !(compare(context, &base[hint - offset], key) < 0)) {                           \
+            lastOffset = offset;                                                                                     \
+            offset = (offset << 1) + 1;                                                                              \
+        }                                                                                                            \
+        if (offset > maxOffset) offset = maxOffset;                                                                  \
+        ptrdiff_t swap = lastOffset;                                                                                 \
+        lastOffset = hint - offset;                                                                                  \
+        offset = hint - swap;                                                                                        \
+    }                                                                                                                \
+    lastOffset++;                                                                                                    \
+    while (lastOffset < offset) {                                                                                    \
+        ptrdiff_t middle = lastOffset + ((offset - lastOffset) >> 1);                                                \
+        if (compare(context, &base[middle], key) < 0) {                                                              \
+            lastOffset = middle + 1;                                                                                 \
+        } else {                                                                                                     \
+            offset = middle;                                                                                         \
+        }                                                                                                            \
+    }                                                                                                                \
+    return offset;                                                                                                   \
+}                                                                                                                    \
+                                                                                                                     \
+/* Rightmost position for key in the sorted base[0..n), searching outward from hint */                               \
+static ptrdiff_t name##GallopRight(void *context, const type *key, const type *base, ptrdiff_t n, ptrdiff_t hint) {  \
+    ptrdiff_t lastOffset = 0, offset = 1;                                                                            \
+    if (compare(context, key, &base[hint]) < 0) {                                                                    \
+        ptrdiff_t maxOffset = hint + 1;                                                                              \
+        while (offset < maxOffset && compare(context, key, &base[hint - offset]) < 0) {                              \
+            lastOffset = offset;                                                                                     \
+            offset = (offset << 1) + 1;                                                                              \
+        }                                                                                                            \
+        if (offset > maxOffset) offset = maxOffset;                                                                  \
+        ptrdiff_t swap = lastOffset;                                                                                 \
+        lastOffset = hint - offset;                                                                                  \
+        offset = hint - swap;                                                                                        \
+    } else {                                                                                                         \
+        ptrdiff_t maxOffset = n - hint;                                                                              \
+        while (offset < maxOffset && !(compare(context, key, &base[hint + offset]) < 0)) {                           \
+            lastOffset = offset;                                                                                     \
+            offset = (offset << 1) + 1;                                                                              \
+        }                                                                                                            \
+        if (offset > maxOffset) offset = maxOffset;                                                                  \
+        lastOffset += hint;                                                                                          \
+        offset += hint;                                                                                              \
+    }                                                                                                                \
+    lastOffset++;                                                                                                    \
+    while (lastOffset < offset) {                                                                                    \
+        ptrdiff_t middle = lastOffset + ((offset - lastOffset) >> 1);                                                \
+        if (compare(context, key, &base[middle]) < 0) {                                                              \
+            offset = middle;                                                                                         \
+        } else {                                                                                                     \
+            lastOffset = middle + 1;                                                                                 \
+        }                                                                                                            \
+    }                                                                                                                \
+    return offset;                                                                                                   \
+}                                                                                                                    \
+                                                                                                                     \
+/* Stable insertion of array[start..high) into the sorted prefix array[low..start) */                                \
+static void name##BinaryInsertion(void *context, type *array, ptrdiff_t low, ptrdiff_t high, ptrdiff_t start) {      \
+    for (; start < high; start++) {                                                                                  \
+        type pivot = array[start];                                                                                   \
+        ptrdiff_t left = low, right = start;                                                                         \
+        while (left < right) {                                                                                       \
+            ptrdiff_t middle = left + ((right - left) >> 1);                                                         \
+            if (compare(context, &pivot, &array[middle]) < 0) {                                                      \
+                right = middle;                                                                                      \
+            } else {                                                                                                 \
+                left = middle + 1;                                                                                   \
+            }                                                                                                        \
+        }                                                                                                            \
+        memmove(&array[left + 1], &array[left], (start - left) * sizeof(type));                                      \
+        array[left] = pivot;                                                                                         \
+    }                                                                                                                \
+}                                                                                                                    \
+                                                                                                                     \
+/* Length of the natural run at low; strictly descending runs are reversed in place */                               \
+static ptrdiff_t name##CountRun(void *context, type *array, ptrdiff_t low, ptrdiff_t high) {                         \
+    ptrdiff_t end = low + 1;                                                                                         \
+    if (end == high) return 1;                                                                                       \
+    if (compare(context, &array[end], &array[low]) < 0) {                                                            \
+        while (end + 1 < high && compare(context, &array[end + 1], &array[end]) < 0) end++;                          \
+        end++;                                                                                                       \
+        for (ptrdiff_t i = low, j = end - 1; i < j; i++, j--) {                                                      \
+            type swap = array[i];                                                                                    \
+            array[i] = array[j];                                                                                     \
+            array[j] = swap;                                                                                         \
+        }                                                                                                            \
+    } else {                                                                                                         \
+        while (end + 1 < high && !(compare(context, &array[end + 1], &array[end]) < 0)) end++;                       \
+        end++;                                                                                                       \
+    }                                                                                                                \
+    return end - low;                                                                                                \
+}                                                                                                                    \
+                                                                                                                     \
+/* Merge the adjacent runs a (the shorter) and b, with a moved to scratch */                                         \
+static void name##MergeLow(name##State *state, type *a, ptrdiff_t na, type *b, ptrdiff_t nb) {                       \
+    void *context = state->context;                                                                                  \
+    type *destination = a, *pa = state->scratch, *pb = b;                                                            \
+    ptrdiff_t minGallop = state->minGallop;                                                                          \
+    memcpy(pa, a, na * sizeof(type));                                                                                \
+                                                                                                                     \
+    *destination++ = *pb++;                                                                                          \
+    if (--nb == 0) goto succeed;                                                                                     \
+    if (na == 1) goto copyB;                                                                                         \
+    for (;;) {                                                                                                       \
+        ptrdiff_t aCount = 0, bCount = 0;                                                                            \
+        for (;;) {                                                                                                   \
+            if (compare(context, pb, pa) < 0) {                                                                      \
+                *destination++ = *pb++;                                                                              \
+                bCount++;                                                                                            \
+                aCount = 0;                                                                                          \
+                if (--nb == 0) goto succeed;                                                                         \
+                if (bCount >= minGallop) break;                                                                      \
+            } else {                                                                                                 \
+                *destination++ = *pa++;                                                                              \
+                aCount++;                                                                                            \
+                bCount = 0;                                                                                          \
+                if (--na == 1) goto copyB;                                                                           \
+                if (aCount >= minGallop) break;                                                                      \
+            }                                                                                                        \
+        }                                                                                                            \
+        minGallop++;                                                                                                 \
+        do {                                                                                                         \
+            minGallop -= minGallop > 1;                                                                              \
+            ptrdiff_t k = name##GallopRight(context, pb, pa, na, 0);                                                 \
+            aCount = k;                                                                                              \
+            if (k) {                                                                                                 \
+                memcpy(destination, pa, k * sizeof(type));                                                           \
+                destination += k;                                                                                    \
+                pa += k;                                                                                             \
+                na -= k;                                                                                             \
+                if (na == 1) goto copyB;                                                                             \
+                if (na == 0) goto succeed;                                                                           \
+            }                                                                                                        \
+            *destination++ = *pb++;                                                                                  \
+            if (--nb == 0) goto succeed;                                                                             \
+            k = name##GallopLeft(context, pa, pb, nb, 0);                                                            \
+            bCount = k;                                                                                              \
+            if (k) {                                                                                                 \
+                memmove(destination, pb, k * sizeof(type));                                                          \
+                destination += k;                                                                                    \
+                pb += k;                                                                                             \
+                nb -= k;                                                                                             \
+                if (nb == 0) goto succeed;                                                                           \
+            }                                                                                                        \
+            *destination++ = *pa++;                                                                                  \
+            if (--na == 1) goto copyB;                                                                               \
+        } while (aCount >= TIM_SORT_MIN_GALLOP || bCount >= TIM_SORT_MIN_GALLOP);                                    \
+        minGallop++;                                                                                                 \
+    }                                                                                                                \
+succeed:                                                                                                             \
+    state->minGallop = minGallop;                                                                                    \
+    if (na) memcpy(destination, pa, na * sizeof(type));                                                              \
+    return;                                                                                                          \
+copyB:                                                                                                               \
+    state->minGallop = minGallop;                                                                                    \
+    memmove(destination, pb, nb * sizeof(type));                                                                     \
+    destination[nb] = *pa;                                                                                           \
+}                                                                                                                    \
+                                                                                                                     \
+/* Merge the adjacent runs a and b (the shorter), with b moved to scratch, from the high end */                      \
+static void name##MergeHigh(name##State *state, type *a, ptrdiff_t na, type *b, ptrdiff_t nb) {                      \
+    void *context = state->context;                                                                                  \
+    type *baseA = a, *baseB = state->scratch;                                                                        \
+    type *destination = b + nb - 1, *pa = a + na - 1, *pb = baseB + nb - 1;                                          \
+    ptrdiff_t minGallop = state->minGallop;                                                                          \
+    memcpy(baseB, b, nb * sizeof(type));                                                                             \
+                                                                                                                     \
+    *destination-- = *pa--;                                                                                          \
+    if (--na == 0) goto succeed;                                                                                     \
+    if (nb == 1) goto copyA;                                                                                         \
+    for (;;) {                                                                                                       \
+        ptrdiff_t aCount = 0, bCount = 0;                                                                            \
+        for (;;) {                                                                                                   \
+            if (compare(context, pb, pa) < 0) {                                                                      \
+                *destination-- = *pa--;                                                                              \
+                aCount++;                                                                                            \
+                bCount = 0;                                                                                          \
+                if (--na == 0) goto succeed;                                                                         \
+                if (aCount >= minGallop) break;                                                                      \
+            } else {                                                                                                 \
+                *destination-- = *pb--;                                                                              \
+                bCount++;                                                                                            \
+                aCount = 0;                                                                                          \
+                if (--nb == 1) goto copyA;                                                                           \
+                if (bCount >= minGallop) break;                                                                      \
+            }                                                                                                        \
+        }                                                                                                            \
+        minGallop++;                                                                                                 \
+        do {                                                                                                         \
+            minGallop -= minGallop > 1;                                                                              \
+            ptrdiff_t k = na - name##GallopRight(context, pb, baseA, na, na - 1);                                    \
+            aCount = k;                                                                                              \
+            if (k) {                                                                                                 \
+                destination -= k;                                                                                    \
+                pa -= k;                                                                                             \
+                memmove(destination + 1, pa + 1, k * sizeof(type));                                                  \
+                na -= k;                                                                                             \
+                if (na == 0) goto succeed;                                                                           \
+            }                                                                                                        \
+            *destination-- = *pb--;                                                                                  \
+            if (--nb == 1) goto copyA;                                                                               \
+            k = nb - name##GallopLeft(context, pa, baseB, nb, nb - 1);                                               \
+            bCount = k;                                                                                              \
+            if (k) {                                                                                                 \
+                destination -= k;                                                                                    \
+                pb -= k;                                                                                             \
+                memcpy(destination + 1, pb + 1, k * sizeof(type));                                                   \
+                nb -= k;                                                                                             \
+                if (nb == 1) goto copyA;                                                                             \
+                if (nb == 0) goto succeed;                                                                           \
+            }                                                                                                        \
+            *destination-- = *pa--;                                                                                  \
+            if (--na == 0) goto succeed;                                                                             \
+        } while (aCount >= TIM_SORT_MIN_GALLOP || bCount >= TIM_SORT_MIN_GALLOP);                                    \
+        minGallop++;                                                                                                 \
+    }                                                                                                                \
+succeed:                                                                                                             \
+    state->minGallop = minGallop;                                                                                    \
+    if (nb) memcpy(destination - (nb - 1), baseB, nb * sizeof(type));                                                \
+    return;                                                                                                          \
+copyA:                                                                                                               \
+    state->minGallop = minGallop;                                                                                    \
+    destination -= na;                                                                                               \
+    pa -= na;                                                                                                        \
+    memmove(destination + 1, pa + 1, na * sizeof(type));                                                             \
+    *destination = *pb;                                                                                              \
+}                                                                                                                    \
+                                                                                                                     \
+/* Merge runs i and i + 1 of the run stack */                                                                        \
+static void name##MergeAt(name##State *state, int i) {                                                               \
+    type *array = state->array;                                                                                      \
+    ptrdiff_t baseA = state->runBase[i], na = state->runLength[i];                                                   \
+    ptrdiff_t baseB = state->runBase[i + 1], nb = state->runLength[i + 1];                                           \
+                                                                                                                     \
+    state->runLength[i] = na + nb;                                                                                   \
+    if (i == state->runCount - 3) {                                                                                  \
+        state->runBase[i + 1] = state->runBase[i + 2];                                                               \
+        state->runLength[i + 1] = state->runLength[i + 2];                                                           \
+    }                                                                                                                \
+    state->runCount--;                                                                                               \
+                                                                                                                     \
+    /* Elements of a already in place before b[0], and of b already in place after a's last */                       \
+    ptrdiff_t k = name##GallopRight(state->context, &array[baseB], &array[baseA], na, 0);                            \
+    baseA += k;                                                                                                      \
+    na -= k;                                                                                                         \
+    if (na == 0) return;                                                                                             \
+    nb = name##GallopLeft(state->context, &array[baseA + na - 1], &array[baseB], nb, nb - 1);                        \
+    if (nb == 0) return;                                                                                             \
+                                                                                                                     \
+    if (na <= nb) {                                                                                                  \
+        name##MergeLow(state, &array[baseA], na, &array[baseB], nb);                                                 \
+    } else {                                                                                                         \
+        name##MergeHigh(state, &array[baseA], na, &array[baseB], nb);                                                \
+    }                                                                                                                \
+}                                                                                                                    \
+                                                                                                                     \
+/* Restore the run-length invariants of the stack after a push */                                                    \
+static void name##MergeCollapse(name##State *state) {                                                                \
+    ptrdiff_t *length = state->runLength;                                                                            \
+    while (state->runCount > 1) {                                                                                    \
+        int i = state->runCount - 2;                                                                                 \
+        if ((i > 0 && length[i - 1] <= length[i] + length[i + 1]) ||                                                 \
+            (i > 1 && length[i - 2] <= length[i - 1] + length[i])) {                                                 \
+            if (length[i - 1] < length[i + 1]) i--;                                                                  \
+            name##MergeAt(state, i);                                                                                 \
+        } else if (length[i] <= length[i + 1]) {                                                                     \
+            name##MergeAt(state, i);                                                                                 \
+        } else {                                                                                                     \
+            break;                                                                                                   \
+        }                                                                                                            \
+    }                                                                                                                \
+}                                                                                                                    \
+                                                                                                                     \
+int name(type *array, size_t count, void *context, const LargeAllocator *allocator) {                                \
+    if (count < 2) {                                                                                                 \
+        return 0;                                                                                                    \
+    }                                                                                                                \
+    ptrdiff_t n = (ptrdiff_t)count;                                                                                  \
+    ptrdiff_t minRun = n, extra = 0;                                                                                 \
+    while (minRun >= 64) {                                                                                           \
+        extra |= minRun & 1;                                                                                         \
+        minRun >>= 1;                                                                                                \
+    }                                                                                                                \
+    minRun += extra;                                                                                                 \
+                                                                                                                     \
+    name##State state;                                                                                               \
+    state.array = array;                                                                                             \
+    state.context = context;                                                                                         \
+    state.minGallop = TIM_SORT_MIN_GALLOP;                                                                           \
+    state.runCount = 0;                                                                                              \
+    state.scratch = rosterLargeAlloc(allocator, (count / 2 + 1) * sizeof(type));                                     \
+    if (state.scratch == NULL) {                                                                                     \
+        return -1;                                                                                                   \
+    }                                                                                                                \
+                                                                                                                     \
+    for (ptrdiff_t low = 0; low < n;) {                                                                              \
+        ptrdiff_t run = name##CountRun(context, array, low, n);                                                      \
+        /* Short runs are extended to minRun with a binary insertion sort */                                         \
+        if (run < minRun) {                                                                                          \
+            ptrdiff_t forced = n - low < minRun ? n - low : minRun;                                                  \
+            name##BinaryInsertion(context, array, low, low + forced, low + run);                                     \
+            run = forced;                                                                                            \
+        }                                                                                                            \
+        state.runBase[state.runCount] = low;                                                                         \
+        state.runLength[state.runCount] = run;                                                                       \
+        state.runCount++;                                                                                            \
+        name##MergeCollapse(&state);                                                                                 \
+        low += run;                                                                                                  \
+    }                                                                                                                \
+    while (state.runCount > 1) {                                                                                     \
+        int i = state.runCount - 2;                                                                                  \
+        if (i > 0 && state.runLength[i - 1] < state.runLength[i + 1]) i--;                                           \
+        name##MergeAt(&state, i);                                                                                    \
+    }                                                                                                                \
+    rosterLargeFree(allocator, state.scratch);                                                                       \
+    return 0;                                                                                                        \
+}
+
+// rosterCompareStudents, inlinable into the sort: domestic before international, then the record order
+static inline int compareStudentRecords(void *context, const Student *a, const Student *b) {
+    (void)context;
+    if (a->status != b->status) return (a->status == 'D') ? -1 : 1;
+    if (a->year != b->year) return a->year - b->year;
+    if (a->month != b->month) return a->month - b->month;
+    if (a->day != b->day) return a->day - b->day;
+    int lastNameComparison = strcmp(a->lastName, b->lastName);
+    if (lastNameComparison != 0) return lastNameComparison;
+    int firstNameComparison = strcmp(a->firstName, b->firstName);
+    if (firstNameComparison != 0) return firstNameComparison;
+    if (a->gpa != b->gpa) return (a->gpa > b->gpa) ? -1 : 1;
+    if (a->status == 'I') return b->toefl - a->toefl;
+    return 0;
+}
+
+// Validation and parsing
+const char* rosterMonthAbbreviation(int month);
+void rosterDivideBirthDigits(const char *birthDigits, int *day, int *month, int *year);
+int rosterParseStudentRecord(const char *line, Student *student, char *message, size_t messageSize, char *detail,
+                       size_t detailSize);
+int rosterParseDateKey(const char *text);
+int rosterCompareStudents(const void *a, const void *b);
+int rosterSortStudents(Student *array, size_t count, void *context, const LargeAllocator *allocator);
+
+int rosterOptionIncludes(int option, const Student *student);
+
+// Large buffers; allocator may be NULL for malloc
+void *rosterLargeAlloc(const LargeAllocator *allocator, size_t bytes);
+void rosterLargeFree(const LargeAllocator *allocator, void *buffer);
+void *rosterLargeRealloc(const LargeAllocator *allocator, void *buffer, size_t oldBytes, size_t newBytes);
+
+// Roster. Functions returning int return 0, or -1 if out of memory.
+int rosterInit(Roster *roster, const LargeAllocator *allocator);
+int rosterEnableIndex(Roster *roster);
+int rosterEnableDedup(Roster *roster, int mode);
+int rosterAdd(Roster *roster, const Student *student);
+void rosterSelect(Roster *roster, int option);
+int rosterIndexBuildDateOrder(Roster *roster);
+int rosterBuildIndex(Roster *roster);
+void rosterFree(Roster *roster);
+
+// Serializer. A buffer that runs out of memory drops every later append and stays failed;
+// rosterRecordWriterFlush and rosterRecordWriterFinish then return -1 without writing.
+void rosterAppendBytes(OutputBuffer *buffer, const void *bytes, size_t length);
+void rosterAppendChar(OutputBuffer *buffer, char c);
+void rosterAppendLittleEndian(OutputBuffer *buffer, unsigned long long value, int bytes);
+void rosterRecordWriterInit(RecordWriter *writer, FILE *file, int format);
+void rosterRecordWriterInitSlice(RecordWriter *writer, int format, unsigned long long poolBase);
+void rosterRecordWriterAdd(RecordWriter *writer, const Student *student);
+int rosterRecordWriterFlush(RecordWriter *writer);
+int rosterRecordWriterFinish(RecordWriter *writer);
+void rosterWrite(RecordWriter *output, const Roster *roster, int option);
+
+// Queries and key plans
+int rosterIndexFindName(const Roster *roster, int option, const char *lastName, const char *firstName, int year,
+                  Student **matches);
+int rosterQueryByName(const Roster *roster, RecordWriter *output, int option, const char *lastName,
+                      const char *firstName);
+int rosterQueryByDateRange(const Roster *roster, RecordWriter *output, int option, int fromKey, int toKey);
+int rosterParseSortPlan(const char *spec, SortPlan *plan);
+int rosterSortStudentsByPlan(Student *students, int count, const SortPlan *plan, const LargeAllocator *allocator);
+
+const Student *rosterContextStudents(const RosterContext *context, int *count);
+
+#endif